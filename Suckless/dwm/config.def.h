@@ -6,6 +6,8 @@ static const unsigned int snap      = 32;       /* snap pixel */
 static const int swallowfloating    = 0;        /* 1 means swallow floating windows by default */
 static const int showbar            = 1;        /* 0 means no bar */
 static const int topbar             = 1;        /* 0 means bottom bar */
+static const int barinterval        = 16;       /* ms between bar redraws for title and status changes */
+static const char *statussock       = "dwm-status"; /* status blocks socket, NULL disables, see dwm(1) */
 static const char *fonts[]          = { "monospace:size=10" };
 static const char dmenufont[]       = "monospace:size=10";
 static const char col_gray1[]       = "#222222";
@@ -27,11 +29,11 @@ static const Rule rules[] = {
 	 *	WM_CLASS(STRING) = instance, class
 	 *	WM_NAME(STRING) = title
 	 */
-	/* class     instance  title           tags mask  isfloating  isterminal  noswallow  monitor */
-	{ "Gimp",    NULL,     NULL,           0,         1,          0,           0,        -1 },
-	{ "Firefox", NULL,     NULL,           1 << 8,    0,          0,          -1,        -1 },
-	{ "St",      NULL,     NULL,           0,         0,          1,           0,        -1 },
-	{ NULL,      NULL,     "Event Tester", 0,         0,          0,           1,        -1 }, /* xev */
+	/* class     instance  title           tags mask  isfloating  isterminal  noswallow  nounmap  nobypass  monitor */
+	{ "Gimp",    NULL,     NULL,           0,         1,          0,           0,        0,       0,       -1 },
+	{ "Firefox", NULL,     NULL,           1 << 8,    0,          0,          -1,        0,       0,       -1 },
+	{ "St",      NULL,     NULL,           0,         0,          1,           0,        0,       0,       -1 },
+	{ NULL,      NULL,     "Event Tester", 0,         0,          0,           1,        0,       0,       -1 }, /* xev */
 };
 
 /* layout(s) */
@@ -39,6 +41,7 @@ static const float mfact     = 0.55; /* factor of master area size [0.05..0.95]
 static const int nmaster     = 1;    /* number of clients in master area */
 static const int resizehints = 1;    /* 1 means respect size hints in tiled resizals */
 static const int lockfullscreen = 1; /* 1 will force focus on the fullscreen window */
+static const int hideunmap   = 1;    /* 1 means unmap clients on hidden tags, 0 moves them off screen */
 
 static const Layout layouts[] = {
 	/* symbol     arrange function */
@@ -223,6 +223,16 @@ drw_setscheme(Drw *drw, Clr *scm)
 		drw->scheme = scm;
 }
 
+/* draw into d instead of the own pixmap, returns the previous target */
+Drawable
+drw_setdrawable(Drw *drw, Drawable d)
+{
+	Drawable old = drw->drawable;
+
+	drw->drawable = d;
+	return old;
+}
+
 void
 drw_rect(Drw *drw, int x, int y, unsigned int w, unsigned int h, int filled, int invert)
 {
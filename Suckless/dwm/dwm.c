@@ -21,14 +21,20 @@
  * To understand everything else, start reading main().
  */
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
@@ -36,6 +42,8 @@
 #include <X11/Xlib.h>
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/sync.h>
+#include <X11/extensions/Xrandr.h>
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
@@ -56,19 +64,22 @@
 #define INTERSECT(x,y,w,h,m)    (MAX(0, MIN((x)+(w),(m)->wx+(m)->ww) - MAX((x),(m)->wx)) \
                                * MAX(0, MIN((y)+(h),(m)->wy+(m)->wh) - MAX((y),(m)->wy)))
 #define ISVISIBLE(C)            ((C->tags & C->mon->tagset[C->mon->seltags]))
+#define ISFULLSCREEN(M)         ((M)->sel && (M)->sel->isfullscreen && ISVISIBLE((M)->sel))
 #define LENGTH(X)               (sizeof X / sizeof X[0])
 #define MOUSEMASK               (BUTTONMASK|PointerMotionMask)
 #define WIDTH(X)                ((X)->w + 2 * (X)->bw)
 #define HEIGHT(X)               ((X)->h + 2 * (X)->bw)
 #define TAGMASK                 ((1 << LENGTH(tags)) - 1)
 #define TEXTW(X)                (drw_fontset_getwidth(drw, (X)) + lrpad)
+#define SYNCTIMEOUT             250 /* ms to wait for a sync request ack */
 
 /* enums */
 enum { CurNormal, CurResize, CurMove, CurLast }; /* cursor */
 enum { SchemeNorm, SchemeSel }; /* color schemes */
 enum { NetSupported, NetWMName, NetWMState, NetWMCheck,
        NetWMFullscreen, NetActiveWindow, NetWMWindowType,
-       NetWMWindowTypeDialog, NetClientList, NetLast }; /* EWMH atoms */
+       NetWMWindowTypeDialog, NetClientList, NetWMSyncRequest,
+       NetWMSyncCounter, NetWMBypassCompositor, NetLast }; /* EWMH atoms */
 enum { WMProtocols, WMDelete, WMState, WMTakeFocus, WMLast }; /* default atoms */
 enum { ClkTagBar, ClkLtSymbol, ClkStatusText, ClkWinTitle,
        ClkClientWin, ClkRootWin, ClkLast }; /* clicks */
@@ -98,7 +109,19 @@ struct Client {
 	int basew, baseh, incw, inch, maxw, maxh, minw, minh, hintsvalid;
 	int bw, oldbw;
 	unsigned int tags;
-	int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen, isterminal, noswallow;
+	int isfixed, isfloating, isurgent, neverfocus, oldstate, isfullscreen, isterminal, noswallow, titledirty;
+	int ishidden;    /* moved off screen by showhide() */
+	int isunmapped;  /* unmapped by showhide() */
+	int ignoreunmap; /* UnmapNotify events caused by showhide() */
+	int nounmap;
+	int nobypass;    /* never hint compositors to unredirect it */
+	int isbypassed;  /* _NET_WM_BYPASS_COMPOSITOR set by updatebypass() */
+	int bypasshint;  /* the client's own value, restored by setbypass() */
+	unsigned long bypassserial; /* PropertyNotify caused by setbypass() */
+	XSyncAlarm syncalarm; /* fires when the client acked a sync request */
+	int64_t syncvalue;    /* value of the last sync request */
+	int syncpending;
+	long synctime;        /* mstime() of the last sync request */
 	pid_t pid;
 	Client *next;
 	Client *snext;
@@ -119,6 +142,18 @@ typedef struct {
 	void (*arrange)(Monitor *);
 } Layout;
 
+/* bar segments as last drawn into Monitor.barpix */
+typedef struct {
+	int valid;                  /* 0 forces a full redraw */
+	unsigned int sel, occ, urg, fill; /* tag masks */
+	char ltsymbol[16];
+	int ltw;
+	char status[256];
+	int tw;                     /* status width, 0 off the selected monitor */
+	char title[256];            /* empty without a selected client */
+	int titlex, titlew, titlescm, titlebox;
+} BarCache;
+
 typedef struct Pertag Pertag;
 struct Monitor {
 	char ltsymbol[16];
@@ -133,15 +168,50 @@ struct Monitor {
 	unsigned int tagset[2];
 	int showbar;
 	int topbar;
+	int bardirty;
+	int frame;            /* ms between refreshes of the output */
+	int syncarrange;      /* arrange once the clients acked their resizes */
 	Client *clients;
 	Client *sel;
 	Client *stack;
 	Monitor *next;
 	Window barwin;
+	Pixmap barpix;
+	int barpixw;
+	BarCache bar;
 	const Layout *lt[2];
 	Pertag *pertag;
 };
 
+/* open addressing table from X window id to client */
+typedef struct {
+	Window win;
+	Client *c;
+} WinSlot;
+
+typedef struct {
+	WinSlot *slot;
+	unsigned int size, n; /* size is a power of two */
+} WinIndex;
+
+/* replies manage() needs, requested ahead by prefetch() */
+enum { PfNetName, PfName, PfTrans, PfClass, PfNetState, PfNetType,
+       PfNormalHints, PfHints, PfProtocols, PfState, PfSyncCounter, PfBypass,
+       PfLast };
+
+typedef struct {
+	Window win;
+	xcb_get_window_attributes_cookie_t attrck;
+	xcb_get_geometry_cookie_t geomck;
+	xcb_get_property_cookie_t propck[PfLast];
+	xcb_res_query_client_ids_cookie_t pidck;
+	xcb_get_window_attributes_reply_t *attr;
+	xcb_get_geometry_reply_t *geom;
+	xcb_get_property_reply_t *prop[PfLast];
+	unsigned int fetched; /* bit mask of prop[] taken from their cookies */
+	int attrfetched, pidfetched;
+} Prefetch;
+
 typedef struct {
 	const char *class;
 	const char *instance;
@@ -150,6 +220,8 @@ typedef struct {
 	int isfloating;
 	int isterminal;
 	int noswallow;
+	int nounmap;
+	int nobypass;
 	int monitor;
 } Rule;
 
@@ -173,6 +245,7 @@ static void destroynotify(XEvent *e);
 static void detach(Client *c);
 static void detachstack(Client *c);
 static Monitor *dirtomon(int dir);
+static Bool dragevent(Display *dpy, XEvent *ev, XPointer arg);
 static void drawbar(Monitor *m);
 static void drawbars(void);
 static void enternotify(XEvent *e);
@@ -181,13 +254,23 @@ static void focus(Client *c);
 static void focusin(XEvent *e);
 static void focusmon(const Arg *arg);
 static void focusstack(const Arg *arg);
+static long flushbars(void);
+static long flushsync(void);
 static Atom getatomprop(Client *c, Atom prop);
+static int getbypass(Window w);
+static int getattrs(Window w, XWindowAttributes *wa);
+static xcb_get_property_reply_t *getprop(Window w, Atom atom);
 static int getrootptr(int *x, int *y);
 static long getstate(Window w);
 static int gettextprop(Window w, Atom atom, char *text, unsigned int size);
+static int gettransient(Window w, Window *trans);
 static void grabbuttons(Client *c, int focused);
 static void grabkeys(void);
+static int hasprotocol(Client *c, Atom proto);
 static void incnmaster(const Arg *arg);
+static void indexdel(WinIndex *idx, Window w);
+static Client *indexget(WinIndex *idx, Window w);
+static void indexput(WinIndex *idx, Window w, Client *c);
 static void keypress(XEvent *e);
 static void killclient(const Arg *arg);
 static void manage(Window w, XWindowAttributes *wa);
@@ -196,10 +279,15 @@ static void maprequest(XEvent *e);
 static void monocle(Monitor *m);
 static void motionnotify(XEvent *e);
 static void movemouse(const Arg *arg);
+static long mstime(void);
 static Client *nexttiled(Client *c);
+static Prefetch *pfget(Window w);
 static void pop(Client *c);
+static void prefetch(Window w);
+static void prefetchdone(void);
 static void propertynotify(XEvent *e);
 static void quit(const Arg *arg);
+static void readstatus(void);
 static Monitor *recttomon(int x, int y, int w, int h);
 static void resize(Client *c, int x, int y, int w, int h, int interact);
 static void resizeclient(Client *c, int x, int y, int w, int h);
@@ -209,6 +297,7 @@ static void run(void);
 static void scan(void);
 static int sendevent(Client *c, Atom proto);
 static void sendmon(Client *c, Monitor *m);
+static void setbypass(Client *c, int bypass);
 static void setclientstate(Client *c, long state);
 static void setfocus(Client *c);
 static void setfullscreen(Client *c, int fullscreen);
@@ -218,6 +307,11 @@ static void setup(void);
 static void seturgent(Client *c, int urg);
 static void showhide(Client *c);
 static void spawn(const Arg *arg);
+static int statuspath(char *buf, size_t size);
+static int syncbusy(Monitor *m);
+static void syncnotify(XEvent *e);
+static void syncrequest(Client *c);
+static int syncwaiting(Client *c);
 static void tag(const Arg *arg);
 static void tagmon(const Arg *arg);
 static void tile(Monitor *m);
@@ -230,11 +324,14 @@ static void unmanage(Client *c, int destroyed);
 static void unmapnotify(XEvent *e);
 static void updatebarpos(Monitor *m);
 static void updatebars(void);
+static void updatebypass(Monitor *m);
 static void updateclientlist(void);
 static int updategeom(void);
 static void updatenumlockmask(void);
+static void updaterefresh(void);
 static void updatesizehints(Client *c);
 static void updatestatus(void);
+static void updatesync(Client *c);
 static void updatetitle(Client *c);
 static void updatewindowtype(Client *c);
 static void updatewmhints(Client *c);
@@ -247,7 +344,6 @@ static int xerrorstart(Display *dpy, XErrorEvent *ee);
 static void zoom(const Arg *arg);
 
 static pid_t getparentprocess(pid_t p);
-static int isdescprocess(pid_t p, pid_t c);
 static Client *swallowingclient(Window w);
 static Client *termforwin(const Client *c);
 static pid_t winpid(Window w);
@@ -255,12 +351,17 @@ static pid_t winpid(Window w);
 /* variables */
 static const char broken[] = "broken";
 static char stext[256];
+static char stblocks[16][sizeof stext]; /* status blocks set through statussock */
+static int statusfd = -1;
+static int statusipc;         /* the status comes from statussock, not the root name */
 static int screen;
 static int sw, sh;           /* X display screen geometry width, height */
 static int bh;               /* bar height */
 static int lrpad;            /* sum of left and right padding for text */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
+static unsigned long enterserial; /* EnterNotify before this came from restack() */
+static int barsdirty, statusdirty; /* pending for flushbars() */
 static void (*handler[LASTEvent]) (XEvent *) = {
 	[ButtonPress] = buttonpress,
 	[ClientMessage] = clientmessage,
@@ -285,8 +386,15 @@ static Display *dpy;
 static Drw *drw;
 static Monitor *mons, *selmon;
 static Window root, wmcheckwin;
+static WinIndex clientindex;  /* c->win of every managed client */
+static WinIndex swallowindex; /* swallowed window to the client swallowing it */
 
 static xcb_connection_t *xcon;
+static int syncevbase = -1;
+static int rrevbase = -1;     /* RandR 1.3 or later, see updaterefresh() */
+static Atom pfatom[PfLast];
+static Prefetch *pfs;
+static unsigned int npf, pfsize;
 
 /* configuration, allows nested code to access above variables */
 #include "config.h"
@@ -303,6 +411,8 @@ struct Pertag {
 /* compile-time check if all tags fit into an unsigned int bit array. */
 struct NumTags { char limitexceeded[LENGTH(tags) > 31 ? -1 : 1]; };
 
+static unsigned int tagw[LENGTH(tags)]; /* TEXTW() of each tag */
+
 /* function implementations */
 void
 applyrules(Client *c)
@@ -311,14 +421,23 @@ applyrules(Client *c)
 	unsigned int i;
 	const Rule *r;
 	Monitor *m;
-	XClassHint ch = { NULL, NULL };
+	xcb_get_property_reply_t *p;
+	char buf[256];
+	int len;
 
 	/* rule matching */
 	c->isfloating = 0;
 	c->tags = 0;
-	XGetClassHint(dpy, c->win, &ch);
-	class    = ch.res_class ? ch.res_class : broken;
-	instance = ch.res_name  ? ch.res_name  : broken;
+	class = instance = broken;
+	if ((p = getprop(c->win, XA_WM_CLASS)) && p->type == XA_STRING && p->format == 8) {
+		/* "instance\0class\0" */
+		len = MIN(xcb_get_property_value_length(p), sizeof buf - 1);
+		memcpy(buf, xcb_get_property_value(p), len);
+		buf[len] = '\0';
+		instance = buf;
+		class = buf + MIN(strlen(buf) + 1, len);
+	}
+	free(p);
 
 	for (i = 0; i < LENGTH(rules); i++) {
 		r = &rules[i];
@@ -328,6 +447,8 @@ applyrules(Client *c)
 		{
 			c->isterminal = r->isterminal;
 			c->noswallow  = r->noswallow;
+			c->nounmap    = r->nounmap;
+			c->nobypass   = r->nobypass;
 			c->isfloating = r->isfloating;
 			c->tags |= r->tags;
 			for (m = mons; m && m->num != r->monitor; m = m->next);
@@ -335,10 +456,6 @@ applyrules(Client *c)
 				c->mon = m;
 		}
 	}
-	if (ch.res_class)
-		XFree(ch.res_class);
-	if (ch.res_name)
-		XFree(ch.res_name);
 	c->tags = c->tags & TAGMASK ? c->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
 }
 
@@ -428,8 +545,10 @@ void
 arrangemon(Monitor *m)
 {
 	strncpy(m->ltsymbol, m->lt[m->sellt]->symbol, sizeof m->ltsymbol);
+	m->syncarrange = 0;
 	if (m->lt[m->sellt]->arrange)
 		m->lt[m->sellt]->arrange(m);
+	updatebypass(m);
 }
 
 void
@@ -449,6 +568,7 @@ attachstack(Client *c)
 void
 swallow(Client *p, Client *c)
 {
+	int h;
 
 	if (c->noswallow || c->isterminal)
 		return;
@@ -460,6 +580,8 @@ swallow(Client *p, Client *c)
 
 	setclientstate(c, WithdrawnState);
 	XUnmapWindow(dpy, p->win);
+	if (p->isbypassed)
+		setbypass(p, 0);
 
 	p->swallowing = c;
 	c->mon = p->mon;
@@ -467,8 +589,23 @@ swallow(Client *p, Client *c)
 	Window w = p->win;
 	p->win = c->win;
 	c->win = w;
+	indexdel(&clientindex, w);
+	indexput(&clientindex, p->win, p);
+	indexput(&swallowindex, w, p);
 	updatetitle(p);
 	XMoveResizeWindow(dpy, p->win, p->x, p->y, p->w, p->h);
+	p->ishidden = 0;
+	/* p takes over the state of the window c was hidden with */
+	p->isunmapped = c->isunmapped;
+	p->ignoreunmap = c->ignoreunmap;
+	/* the hints stay with the windows */
+	h = p->bypasshint;
+	p->bypasshint = c->bypasshint;
+	c->bypasshint = h;
+	p->isbypassed = c->isbypassed;
+	c->isbypassed = 0;
+	updatesync(p);
+	updatesync(c);
 	arrange(p->mon);
 	configure(p);
 	updateclientlist();
@@ -477,9 +614,17 @@ swallow(Client *p, Client *c)
 void
 unswallow(Client *c)
 {
+	indexdel(&clientindex, c->win);
+	indexdel(&swallowindex, c->swallowing->win);
 	c->win = c->swallowing->win;
+	c->bypasshint = c->swallowing->bypasshint;
+	c->isbypassed = 0;
+	indexput(&clientindex, c->win, c);
 
+	if (c->swallowing->syncalarm)
+		XSyncDestroyAlarm(dpy, c->swallowing->syncalarm);
 	free(c->swallowing);
+	updatesync(c);
 	c->swallowing = NULL;
 
 	/* unfullscreen the client */
@@ -488,6 +633,7 @@ unswallow(Client *c)
 	arrange(c->mon);
 	XMapWindow(dpy, c->win);
 	XMoveResizeWindow(dpy, c->win, c->x, c->y, c->w, c->h);
+	c->ishidden = c->isunmapped = c->ignoreunmap = 0;
 	setclientstate(c, NormalState);
 	focus(NULL);
 	arrange(c->mon);
@@ -512,14 +658,14 @@ buttonpress(XEvent *e)
 	if (ev->window == selmon->barwin) {
 		i = x = 0;
 		do
-			x += TEXTW(tags[i]);
+			x += tagw[i];
 		while (ev->x >= x && ++i < LENGTH(tags));
 		if (i < LENGTH(tags)) {
 			click = ClkTagBar;
 			arg.ui = 1 << i;
-		} else if (ev->x < x + TEXTW(selmon->ltsymbol))
+		} else if (ev->x < x + selmon->bar.ltw)
 			click = ClkLtSymbol;
-		else if (ev->x > selmon->ww - (int)TEXTW(stext))
+		else if (ev->x > selmon->ww - selmon->bar.tw - lrpad + 2)
 			click = ClkStatusText;
 		else
 			click = ClkWinTitle;
@@ -567,6 +713,11 @@ cleanup(void)
 	for (i = 0; i < LENGTH(colors); i++)
 		free(scheme[i]);
 	free(scheme);
+	free(clientindex.slot);
+	free(swallowindex.slot);
+	free(pfs);
+	if (statusfd >= 0)
+		close(statusfd);
 	XDestroyWindow(dpy, wmcheckwin);
 	drw_free(drw);
 	XSync(dpy, False);
@@ -587,6 +738,8 @@ cleanupmon(Monitor *mon)
 	}
 	XUnmapWindow(dpy, mon->barwin);
 	XDestroyWindow(dpy, mon->barwin);
+	if (mon->barpix)
+		XFreePixmap(dpy, mon->barpix);
 	free(mon);
 }
 
@@ -642,6 +795,7 @@ configurenotify(XEvent *e)
 		sw = ev->width;
 		sh = ev->height;
 		if (updategeom() || dirty) {
+			updaterefresh();
 			drw_resize(drw, sw, bh);
 			updatebars();
 			for (m = mons; m; m = m->next) {
@@ -791,57 +945,125 @@ dirtomon(int dir)
 	return m;
 }
 
+/* the events resizemouse() waits for */
+Bool
+dragevent(Display *dpy, XEvent *ev, XPointer arg)
+{
+	switch (ev->type) {
+	case ButtonPress:
+	case ButtonRelease:
+	case MotionNotify:
+	case ConfigureRequest:
+	case Expose:
+	case MapRequest:
+		return True;
+	}
+	return ev->type == syncevbase + XSyncAlarmNotify;
+}
+
+/* Each segment of the bar is only redrawn when what it shows changed,
+ * and only the changed span is copied to the bar window. */
 void
 drawbar(Monitor *m)
 {
-	int x, w, tw = 0;
+	int x, w, tw = 0, x0, x1, scm, box;
 	int boxs = drw->fonts->h / 9;
 	int boxw = drw->fonts->h / 6 + 2;
-	unsigned int i, occ = 0, urg = 0;
+	unsigned int i, occ = 0, urg = 0, fill = 0, sel, d;
+	const char *title;
+	Drawable buf;
+	BarCache *bc = &m->bar;
 	Client *c;
 
-	if (!m->showbar)
-		return;
+	if (!m->showbar || !m->barpix || ISFULLSCREEN(m))
+		return; /* restack() draws it once the fullscreen client is gone */
+	buf = drw_setdrawable(drw, m->barpix);
+	x0 = m->ww;
+	x1 = 0;
+
+	if (!bc->valid || strcmp(bc->ltsymbol, m->ltsymbol))
+		bc->ltw = TEXTW(m->ltsymbol);
+	for (x = 0, i = 0; i < LENGTH(tags); i++)
+		x += tagw[i];
 
 	/* draw status first so it can be overdrawn by tags later */
 	if (m == selmon) { /* status is only drawn on selected monitor */
-		drw_setscheme(drw, scheme[SchemeNorm]);
 		tw = TEXTW(stext) - lrpad + 2; /* 2px right padding */
-		drw_text(drw, m->ww - tw, 0, tw, bh, 0, stext, 0);
+		if (!bc->valid || tw != bc->tw || strcmp(bc->status, stext)) {
+			drw_setscheme(drw, scheme[SchemeNorm]);
+			drw_text(drw, m->ww - tw, 0, tw, bh, 0, stext, 0);
+			x0 = MIN(x0, m->ww - tw);
+			x1 = m->ww;
+			strcpy(bc->status, stext);
+			if (m->ww - tw < x + bc->ltw)
+				bc->valid = 0;
+		}
 	}
+	bc->tw = tw;
 
 	for (c = m->clients; c; c = c->next) {
 		occ |= c->tags;
 		if (c->isurgent)
 			urg |= c->tags;
 	}
-	x = 0;
-	for (i = 0; i < LENGTH(tags); i++) {
-		w = TEXTW(tags[i]);
-		drw_setscheme(drw, scheme[m->tagset[m->seltags] & 1 << i ? SchemeSel : SchemeNorm]);
-		drw_text(drw, x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i);
-		if (occ & 1 << i)
-			drw_rect(drw, x + boxs, boxs, boxw, boxw,
-				m == selmon && selmon->sel && selmon->sel->tags & 1 << i,
-				urg & 1 << i);
-		x += w;
-	}
-	w = TEXTW(m->ltsymbol);
-	drw_setscheme(drw, scheme[SchemeNorm]);
-	x = drw_text(drw, x, 0, w, bh, lrpad / 2, m->ltsymbol, 0);
+	if (m == selmon && selmon->sel)
+		fill = selmon->sel->tags;
+	sel = m->tagset[m->seltags];
+	for (x = 0, i = 0; i < LENGTH(tags); x += tagw[i++]) {
+		d = 1 << i;
+		if (bc->valid && !(((sel ^ bc->sel) | (occ ^ bc->occ)
+		| (urg ^ bc->urg) | (fill ^ bc->fill)) & d))
+			continue;
+		drw_setscheme(drw, scheme[sel & d ? SchemeSel : SchemeNorm]);
+		drw_text(drw, x, 0, tagw[i], bh, lrpad / 2, tags[i], urg & d);
+		if (occ & d)
+			drw_rect(drw, x + boxs, boxs, boxw, boxw, fill & d, urg & d);
+		x0 = MIN(x0, x);
+		x1 = MAX(x1, x + (int)tagw[i]);
+	}
+	bc->sel = sel;
+	bc->occ = occ;
+	bc->urg = urg;
+	bc->fill = fill;
+
+	w = bc->ltw;
+	if (!bc->valid || strcmp(bc->ltsymbol, m->ltsymbol)) {
+		drw_setscheme(drw, scheme[SchemeNorm]);
+		drw_text(drw, x, 0, w, bh, lrpad / 2, m->ltsymbol, 0);
+		x0 = MIN(x0, x);
+		x1 = MAX(x1, x + w);
+		strcpy(bc->ltsymbol, m->ltsymbol);
+	}
+	x += w;
 
 	if ((w = m->ww - tw - x) > bh) {
-		if (m->sel) {
-			drw_setscheme(drw, scheme[m == selmon ? SchemeSel : SchemeNorm]);
-			drw_text(drw, x, 0, w, bh, lrpad / 2, m->sel->name, 0);
-			if (m->sel->isfloating)
-				drw_rect(drw, x + boxs, boxs, boxw, boxw, m->sel->isfixed, 0);
-		} else {
-			drw_setscheme(drw, scheme[SchemeNorm]);
-			drw_rect(drw, x, 0, w, bh, 1, 1);
+		title = m->sel ? m->sel->name : "";
+		scm = m->sel && m == selmon ? SchemeSel : SchemeNorm;
+		box = m->sel && m->sel->isfloating ? 1 + m->sel->isfixed : 0;
+		if (!bc->valid || x != bc->titlex || w != bc->titlew
+		|| scm != bc->titlescm || box != bc->titlebox || strcmp(title, bc->title)) {
+			drw_setscheme(drw, scheme[scm]);
+			if (m->sel) {
+				drw_text(drw, x, 0, w, bh, lrpad / 2, title, 0);
+				if (box)
+					drw_rect(drw, x + boxs, boxs, boxw, boxw, box - 1, 0);
+			} else
+				drw_rect(drw, x, 0, w, bh, 1, 1);
+			x0 = MIN(x0, x);
+			x1 = MAX(x1, x + w);
+			bc->titlex = x;
+			bc->titlew = w;
+			bc->titlescm = scm;
+			bc->titlebox = box;
+			strcpy(bc->title, title);
 		}
-	}
-	drw_map(drw, m->barwin, 0, 0, m->ww, bh);
+	} else
+		bc->titlew = 0;
+	bc->valid = 1;
+
+	if (x1 > x0)
+		drw_map(drw, m->barwin, x0, 0, x1 - x0, bh);
+	drw_setdrawable(drw, buf);
 }
 
 void
@@ -862,6 +1084,8 @@ enternotify(XEvent *e)
 
 	if ((ev->mode != NotifyNormal || ev->detail == NotifyInferior) && ev->window != root)
 		return;
+	if (ev->serial < enterserial)
+		return;
 	c = wintoclient(ev->window);
 	m = c ? c->mon : wintomon(ev->window);
 	if (m != selmon) {
@@ -878,8 +1102,10 @@ expose(XEvent *e)
 	Monitor *m;
 	XExposeEvent *ev = &e->xexpose;
 
-	if (ev->count == 0 && (m = wintomon(ev->window)))
+	if (ev->count == 0 && (m = wintomon(ev->window))) {
+		m->bar.valid = 0;
 		drawbar(m);
+	}
 }
 
 void
@@ -957,22 +1183,174 @@ focusstack(const Arg *arg)
 	}
 }
 
+/* Title, status and bar updates requested through properties are
+ * coalesced and done at most every barinterval ms. Returns the ms until
+ * the pending ones are due, -1 if there are none. */
+long
+flushbars(void)
+{
+	static struct timespec last;
+	struct timespec now;
+	long ms;
+	Client *c;
+	Monitor *m;
+
+	if (!barsdirty)
+		return -1;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - last.tv_sec) * 1000 + (now.tv_nsec - last.tv_nsec) / 1000000;
+	if (ms < barinterval)
+		return barinterval - ms;
+	last = now;
+	barsdirty = 0;
+	if (statusdirty) {
+		statusdirty = 0;
+		updatestatus();
+	}
+	for (m = mons; m; m = m->next) {
+		for (c = m->clients; c; c = c->next) {
+			if (c->titledirty) {
+				c->titledirty = 0;
+				updatetitle(c);
+				/* focus may have moved to c since the change */
+				if (c == m->sel)
+					m->bardirty = 1;
+			}
+		}
+		if (m->bardirty) {
+			m->bardirty = 0;
+			drawbar(m);
+		}
+	}
+	return -1;
+}
+
+/* Does the arranges setmfact() deferred once the clients acked or timed
+ * out. Returns the ms until the next timeout, -1 if none is pending. */
+long
+flushsync(void)
+{
+	Client *c;
+	Monitor *m;
+	long ms = -1, left, now = mstime();
+
+	for (m = mons; m; m = m->next) {
+		if (!m->syncarrange)
+			continue;
+		if (!syncbusy(m)) {
+			arrange(m);
+			continue;
+		}
+		for (c = m->clients; c; c = c->next) {
+			if (!ISVISIBLE(c) || !syncwaiting(c))
+				continue;
+			left = MAX(SYNCTIMEOUT - (now - c->synctime), 1);
+			if (ms < 0 || left < ms)
+				ms = left;
+		}
+	}
+	return ms;
+}
+
 Atom
 getatomprop(Client *c, Atom prop)
 {
-	int di;
-	unsigned long dl;
-	unsigned char *p = NULL;
-	Atom da, atom = None;
+	xcb_get_property_reply_t *p;
+	Atom atom = None;
 
-	if (XGetWindowProperty(dpy, c->win, prop, 0L, sizeof atom, False, XA_ATOM,
-		&da, &di, &dl, &dl, &p) == Success && p) {
-		atom = *(Atom *)p;
-		XFree(p);
-	}
+	if ((p = getprop(c->win, prop)) && p->type == XA_ATOM && p->format == 32
+	&& xcb_get_property_value_length(p) >= 4)
+		atom = *(uint32_t *)xcb_get_property_value(p);
+	free(p);
 	return atom;
 }
 
+/* the _NET_WM_BYPASS_COMPOSITOR value of w, 0 without one */
+int
+getbypass(Window w)
+{
+	xcb_get_property_reply_t *p;
+	int v = 0;
+
+	if ((p = getprop(w, netatom[NetWMBypassCompositor])) && p->type == XA_CARDINAL
+	&& p->format == 32 && xcb_get_property_value_length(p) >= 4)
+		v = *(uint32_t *)xcb_get_property_value(p);
+	free(p);
+	return v;
+}
+
+/* fills the fields of wa that manage() uses */
+int
+getattrs(Window w, XWindowAttributes *wa)
+{
+	Prefetch *pf = pfget(w);
+	xcb_get_window_attributes_reply_t *a;
+	xcb_get_geometry_reply_t *g;
+	xcb_get_window_attributes_cookie_t ac;
+	xcb_get_geometry_cookie_t gc;
+	int ok;
+
+	if (pf) {
+		if (!pf->attrfetched) {
+			pf->attr = xcb_get_window_attributes_reply(xcon, pf->attrck, NULL);
+			pf->geom = xcb_get_geometry_reply(xcon, pf->geomck, NULL);
+			pf->attrfetched = 1;
+		}
+		a = pf->attr;
+		g = pf->geom;
+	} else {
+		ac = xcb_get_window_attributes(xcon, w);
+		gc = xcb_get_geometry(xcon, w);
+		a = xcb_get_window_attributes_reply(xcon, ac, NULL);
+		g = xcb_get_geometry_reply(xcon, gc, NULL);
+	}
+	if ((ok = a && g)) {
+		memset(wa, 0, sizeof *wa);
+		wa->x = g->x;
+		wa->y = g->y;
+		wa->width = g->width;
+		wa->height = g->height;
+		wa->border_width = g->border_width;
+		wa->map_state = a->map_state;
+		wa->override_redirect = a->override_redirect;
+	}
+	if (!pf) {
+		free(a);
+		free(g);
+	}
+	return ok;
+}
+
+/* returns property atom of w, to be freed by the caller */
+xcb_get_property_reply_t *
+getprop(Window w, Atom atom)
+{
+	Prefetch *pf;
+	xcb_get_property_reply_t *p;
+	size_t n;
+	int i;
+
+	if ((pf = pfget(w))) {
+		for (i = 0; i < PfLast; i++) {
+			if (pfatom[i] != atom)
+				continue;
+			if (!(pf->fetched & 1 << i)) {
+				pf->prop[i] = xcb_get_property_reply(xcon, pf->propck[i], NULL);
+				pf->fetched |= 1 << i;
+			}
+			if (!pf->prop[i])
+				return NULL;
+			/* the replies are kept until prefetchdone() */
+			n = sizeof *p + pf->prop[i]->length * 4;
+			p = ecalloc(1, n);
+			memcpy(p, pf->prop[i], n);
+			return p;
+		}
+	}
+	return xcb_get_property_reply(xcon, xcb_get_property(xcon, 0, w, atom,
+		XCB_GET_PROPERTY_TYPE_ANY, 0, 256), NULL);
+}
+
 int
 getrootptr(int *x, int *y)
 {
@@ -986,48 +1364,69 @@ getrootptr(int *x, int *y)
 long
 getstate(Window w)
 {
-	int format;
+	xcb_get_property_reply_t *p;
 	long result = -1;
-	unsigned char *p = NULL;
-	unsigned long n, extra;
-	Atom real;
 
-	if (XGetWindowProperty(dpy, w, wmatom[WMState], 0L, 2L, False, wmatom[WMState],
-		&real, &format, &n, &extra, (unsigned char **)&p) != Success)
-		return -1;
-	if (n != 0)
-		result = *p;
-	XFree(p);
+	if ((p = getprop(w, wmatom[WMState])) && p->type == wmatom[WMState]
+	&& p->format == 32 && xcb_get_property_value_length(p) >= 4)
+		result = *(uint32_t *)xcb_get_property_value(p);
+	free(p);
 	return result;
 }
 
 int
 gettextprop(Window w, Atom atom, char *text, unsigned int size)
 {
-	char **list = NULL;
-	int n;
+	char **list = NULL, *value;
+	int n, len;
 	XTextProperty name;
+	xcb_get_property_reply_t *p;
 
 	if (!text || size == 0)
 		return 0;
 	text[0] = '\0';
-	if (!XGetTextProperty(dpy, w, &name, atom) || !name.nitems)
+	if (!(p = getprop(w, atom)) || !p->type || p->format != 8
+	|| !(len = xcb_get_property_value_length(p))) {
+		free(p);
 		return 0;
-	if (name.encoding == XA_STRING) {
-		strncpy(text, (char *)name.value, size - 1);
-	} else if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
-		strncpy(text, *list, size - 1);
-		XFreeStringList(list);
+	}
+	value = xcb_get_property_value(p);
+	if (p->type == XA_STRING) {
+		memcpy(text, value, MIN(len, size - 1));
+		text[MIN(len, size - 1)] = '\0';
+	} else {
+		name.value = ecalloc(1, len + 1);
+		memcpy(name.value, value, len);
+		name.encoding = p->type;
+		name.format = 8;
+		name.nitems = len;
+		if (XmbTextPropertyToTextList(dpy, &name, &list, &n) >= Success && n > 0 && *list) {
+			strncpy(text, *list, size - 1);
+			XFreeStringList(list);
+		}
+		free(name.value);
 	}
 	text[size - 1] = '\0';
-	XFree(name.value);
+	free(p);
 	return 1;
 }
 
+int
+gettransient(Window w, Window *trans)
+{
+	xcb_get_property_reply_t *p;
+	int ok;
+
+	if ((ok = (p = getprop(w, XA_WM_TRANSIENT_FOR)) && p->type == XA_WINDOW
+	&& p->format == 32 && xcb_get_property_value_length(p) >= 4))
+		*trans = *(uint32_t *)xcb_get_property_value(p);
+	free(p);
+	return ok;
+}
+
 void
 grabbuttons(Client *c, int focused)
 {
-	updatenumlockmask();
 	{
 		unsigned int i, j;
 		unsigned int modifiers[] = { 0, LockMask, numlockmask, numlockmask|LockMask };
@@ -1073,6 +1472,23 @@ grabkeys(void)
 	}
 }
 
+int
+hasprotocol(Client *c, Atom proto)
+{
+	int n, exists = 0;
+	uint32_t *protocols;
+	xcb_get_property_reply_t *p;
+
+	if ((p = getprop(c->win, wmatom[WMProtocols])) && p->type == XA_ATOM && p->format == 32) {
+		protocols = xcb_get_property_value(p);
+		n = xcb_get_property_value_length(p) / 4;
+		while (!exists && n--)
+			exists = protocols[n] == proto;
+	}
+	free(p);
+	return exists;
+}
+
 void
 incnmaster(const Arg *arg)
 {
@@ -1080,6 +1496,79 @@ incnmaster(const Arg *arg)
 	arrange(selmon);
 }
 
+static unsigned int
+winhash(Window w, unsigned int size)
+{
+	unsigned int h = (unsigned int)w * 2654435761u;
+
+	return (h ^ h >> 16) & (size - 1);
+}
+
+void
+indexdel(WinIndex *idx, Window w)
+{
+	unsigned int i, j, k, mask;
+
+	if (!idx->n)
+		return;
+	mask = idx->size - 1;
+	for (i = winhash(w, idx->size); idx->slot[i].win != w; i = (i + 1) & mask)
+		if (!idx->slot[i].win)
+			return;
+	idx->slot[i].win = None;
+	idx->n--;
+	/* shift back the following entries of the probe sequence */
+	for (j = (i + 1) & mask; idx->slot[j].win; j = (j + 1) & mask) {
+		k = winhash(idx->slot[j].win, idx->size);
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		idx->slot[i] = idx->slot[j];
+		idx->slot[j].win = None;
+		i = j;
+	}
+}
+
+Client *
+indexget(WinIndex *idx, Window w)
+{
+	unsigned int i, mask;
+
+	if (!idx->n || !w)
+		return NULL;
+	mask = idx->size - 1;
+	for (i = winhash(w, idx->size); idx->slot[i].win; i = (i + 1) & mask)
+		if (idx->slot[i].win == w)
+			return idx->slot[i].c;
+	return NULL;
+}
+
+void
+indexput(WinIndex *idx, Window w, Client *c)
+{
+	unsigned int i, mask, size;
+	WinSlot *old;
+
+	if (2 * (idx->n + 1) > idx->size) { /* keep the load below 1/2 */
+		old = idx->slot;
+		size = idx->size;
+		idx->size = size ? 2 * size : 64;
+		idx->slot = ecalloc(idx->size, sizeof(WinSlot));
+		idx->n = 0;
+		for (i = 0; i < size; i++)
+			if (old[i].win)
+				indexput(idx, old[i].win, old[i].c);
+		free(old);
+	}
+	mask = idx->size - 1;
+	for (i = winhash(w, idx->size); idx->slot[i].win; i = (i + 1) & mask)
+		if (idx->slot[i].win == w)
+			break;
+	if (!idx->slot[i].win)
+		idx->n++;
+	idx->slot[i].win = w;
+	idx->slot[i].c = c;
+}
+
 #ifdef XINERAMA
 static int
 isuniquegeom(XineramaScreenInfo *unique, size_t n, XineramaScreenInfo *info)
@@ -1142,14 +1631,16 @@ manage(Window w, XWindowAttributes *wa)
 	c->oldbw = wa->border_width;
 
 	updatetitle(c);
-	if (XGetTransientForHint(dpy, w, &trans) && (t = wintoclient(trans))) {
+	if (gettransient(w, &trans) && (t = wintoclient(trans))) {
 		c->mon = t->mon;
 		c->tags = t->tags;
+		c->nounmap = t->nounmap;
 	} else {
 		c->mon = selmon;
 		applyrules(c);
 		term = termforwin(c);
 	}
+	c->bypasshint = getbypass(w);
 
 	if (c->x + WIDTH(c) > c->mon->wx + c->mon->ww)
 		c->x = c->mon->wx + c->mon->ww - WIDTH(c);
@@ -1166,6 +1657,7 @@ manage(Window w, XWindowAttributes *wa)
 	updatewindowtype(c);
 	updatesizehints(c);
 	updatewmhints(c);
+	updatesync(c);
 	XSelectInput(dpy, w, EnterWindowMask|FocusChangeMask|PropertyChangeMask|StructureNotifyMask);
 	grabbuttons(c, 0);
 	if (!c->isfloating)
@@ -1174,15 +1666,20 @@ manage(Window w, XWindowAttributes *wa)
 		XRaiseWindow(dpy, c->win);
 	attach(c);
 	attachstack(c);
+	indexput(&clientindex, c->win, c);
 	XChangeProperty(dpy, root, netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
 		(unsigned char *) &(c->win), 1);
 	XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h); /* some windows require this */
+	c->ishidden = 1;
 	setclientstate(c, NormalState);
 	if (c->mon == selmon)
 		unfocus(selmon->sel, 0);
 	c->mon->sel = c;
 	arrange(c->mon);
-	XMapWindow(dpy, c->win);
+	if (!c->isunmapped)
+		XMapWindow(dpy, c->win);
+	else if (wa->map_state != IsViewable)
+		c->ignoreunmap--; /* it was not mapped, no UnmapNotify follows */
 	if (term)
 		swallow(term, c);
 	focus(NULL);
@@ -1194,8 +1691,8 @@ mappingnotify(XEvent *e)
 	XMappingEvent *ev = &e->xmapping;
 
 	XRefreshKeyboardMapping(ev);
-	if (ev->request == MappingKeyboard)
-		grabkeys();
+	if (ev->request == MappingKeyboard || ev->request == MappingModifier)
+		grabkeys(); /* also updates numlockmask */
 }
 
 void
@@ -1204,10 +1701,12 @@ maprequest(XEvent *e)
 	static XWindowAttributes wa;
 	XMapRequestEvent *ev = &e->xmaprequest;
 
-	if (!XGetWindowAttributes(dpy, ev->window, &wa) || wa.override_redirect)
+	if (wintoclient(ev->window))
 		return;
-	if (!wintoclient(ev->window))
+	prefetch(ev->window);
+	if (getattrs(ev->window, &wa) && !wa.override_redirect)
 		manage(ev->window, &wa);
+	prefetchdone();
 }
 
 void
@@ -1272,7 +1771,7 @@ movemouse(const Arg *arg)
 			handler[ev.type](&ev);
 			break;
 		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
+			if ((ev.xmotion.time - lasttime) <= c->mon->frame)
 				continue;
 			lasttime = ev.xmotion.time;
 
@@ -1302,6 +1801,15 @@ movemouse(const Arg *arg)
 	}
 }
 
+long
+mstime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 Client *
 nexttiled(Client *c)
 {
@@ -1309,6 +1817,74 @@ nexttiled(Client *c)
 	return c;
 }
 
+Prefetch *
+pfget(Window w)
+{
+	unsigned int i;
+
+	for (i = 0; i < npf; i++)
+		if (pfs[i].win == w)
+			return &pfs[i];
+	return NULL;
+}
+
+/* Sends all requests manage() needs for w without waiting for replies,
+ * the getters take them from here until prefetchdone(). */
+void
+prefetch(Window w)
+{
+	Prefetch *pf;
+	int i;
+
+	if (npf == pfsize) {
+		pfsize = pfsize ? 2 * pfsize : 16;
+		if (!(pfs = realloc(pfs, pfsize * sizeof(Prefetch))))
+			die("realloc:");
+	}
+	pf = &pfs[npf++];
+	memset(pf, 0, sizeof *pf);
+	pf->win = w;
+	pf->attrck = xcb_get_window_attributes(xcon, w);
+	pf->geomck = xcb_get_geometry(xcon, w);
+	for (i = 0; i < PfLast; i++)
+		pf->propck[i] = xcb_get_property(xcon, 0, w, pfatom[i],
+			XCB_GET_PROPERTY_TYPE_ANY, 0, 256);
+#ifdef __linux__
+	{
+		xcb_res_client_id_spec_t spec = { w, XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID };
+		pf->pidck = xcb_res_query_client_ids(xcon, 1, &spec);
+	}
+#else
+	pf->pidfetched = 1;
+#endif /* __linux__ */
+}
+
+void
+prefetchdone(void)
+{
+	Prefetch *pf;
+	int i;
+
+	for (pf = pfs; pf < pfs + npf; pf++) {
+		if (pf->attrfetched) {
+			free(pf->attr);
+			free(pf->geom);
+		} else {
+			xcb_discard_reply(xcon, pf->attrck.sequence);
+			xcb_discard_reply(xcon, pf->geomck.sequence);
+		}
+		for (i = 0; i < PfLast; i++) {
+			if (pf->fetched & 1 << i)
+				free(pf->prop[i]);
+			else
+				xcb_discard_reply(xcon, pf->propck[i].sequence);
+		}
+		if (!pf->pidfetched)
+			xcb_discard_reply(xcon, pf->pidck.sequence);
+	}
+	npf = 0;
+}
+
 void
 pop(Client *c)
 {
@@ -1322,18 +1898,29 @@ void
 propertynotify(XEvent *e)
 {
 	Client *c;
+	Monitor *m;
 	Window trans;
 	XPropertyEvent *ev = &e->xproperty;
 
-	if ((ev->window == root) && (ev->atom == XA_WM_NAME))
-		updatestatus();
+	if ((ev->window == root) && (ev->atom == XA_WM_NAME)) {
+		if (!statusipc)
+			statusdirty = barsdirty = 1;
+	}
+	else if (ev->atom == netatom[NetWMBypassCompositor]) {
+		/* set or deleted by the client itself, not by setbypass() */
+		if ((c = wintoclient(ev->window)) && ev->serial != c->bypassserial) {
+			c->bypasshint = getbypass(c->win);
+			c->isbypassed = 0; /* our value is gone */
+			updatebypass(c->mon);
+		}
+	}
 	else if (ev->state == PropertyDelete)
 		return; /* ignore */
 	else if ((c = wintoclient(ev->window))) {
 		switch(ev->atom) {
 		default: break;
 		case XA_WM_TRANSIENT_FOR:
-			if (!c->isfloating && (XGetTransientForHint(dpy, c->win, &trans)) &&
+			if (!c->isfloating && gettransient(c->win, &trans) &&
 				(c->isfloating = (wintoclient(trans)) != NULL))
 				arrange(c->mon);
 			break;
@@ -1342,16 +1929,20 @@ propertynotify(XEvent *e)
 			break;
 		case XA_WM_HINTS:
 			updatewmhints(c);
-			drawbars();
+			for (m = mons; m; m = m->next)
+				m->bardirty = 1;
+			barsdirty = 1;
 			break;
 		}
 		if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName]) {
-			updatetitle(c);
+			c->titledirty = barsdirty = 1;
 			if (c == c->mon->sel)
-				drawbar(c->mon);
+				c->mon->bardirty = 1;
 		}
 		if (ev->atom == netatom[NetWMWindowType])
 			updatewindowtype(c);
+		if (ev->atom == netatom[NetWMSyncCounter] || ev->atom == wmatom[WMProtocols])
+			updatesync(c);
 	}
 }
 
@@ -1361,6 +1952,46 @@ quit(const Arg *arg)
 	running = 0;
 }
 
+/* Each datagram on statussock is "<block> <text>" and replaces the text of
+ * that block, the status is the concatenation of all blocks. */
+void
+readstatus(void)
+{
+	char buf[sizeof stext + 8], text[sizeof stext], *p;
+	unsigned long i;
+	ssize_t n;
+	size_t len;
+	int changed = 0;
+
+	while ((n = recv(statusfd, buf, sizeof buf - 1, MSG_DONTWAIT)) >= 0) {
+		buf[n] = '\0';
+		i = strtoul(buf, &p, 10);
+		if (p == buf || *p++ != ' ' || i >= LENGTH(stblocks))
+			continue;
+		if (strlen(p) >= sizeof stblocks[i])
+			p[sizeof stblocks[i] - 1] = '\0';
+		if (strcmp(stblocks[i], p)) {
+			strcpy(stblocks[i], p);
+			changed = 1;
+		}
+	}
+	if (!changed)
+		return;
+	for (i = len = 0; i < LENGTH(stblocks); i++)
+		for (p = stblocks[i]; *p && len < sizeof text - 1; )
+			text[len++] = *p++;
+	text[len] = '\0';
+	/* with all blocks cleared the root window name is shown again */
+	if (!(statusipc = len > 0)) {
+		statusdirty = barsdirty = 1;
+		return;
+	}
+	if (strcmp(text, stext)) {
+		strcpy(stext, text);
+		selmon->bardirty = barsdirty = 1;
+	}
+}
+
 Monitor *
 recttomon(int x, int y, int w, int h)
 {
@@ -1387,20 +2018,22 @@ resizeclient(Client *c, int x, int y, int w, int h)
 {
 	XWindowChanges wc;
 
+	if (c->syncalarm && (w != c->w || h != c->h))
+		syncrequest(c);
 	c->oldx = c->x; c->x = wc.x = x;
 	c->oldy = c->y; c->y = wc.y = y;
 	c->oldw = c->w; c->w = wc.width = w;
 	c->oldh = c->h; c->h = wc.height = h;
 	wc.border_width = c->bw;
+	c->ishidden = 0;
 	XConfigureWindow(dpy, c->win, CWX|CWY|CWWidth|CWHeight|CWBorderWidth, &wc);
 	configure(c);
-	XSync(dpy, False);
 }
 
 void
 resizemouse(const Arg *arg)
 {
-	int ocx, ocy, nw, nh;
+	int ocx, ocy, nw, nh, pending = 0;
 	Client *c;
 	Monitor *m;
 	XEvent ev;
@@ -1418,7 +2051,16 @@ resizemouse(const Arg *arg)
 		return;
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	do {
-		XMaskEvent(dpy, MOUSEMASK|ExposureMask|SubstructureRedirectMask, &ev);
+		XIfEvent(dpy, &ev, dragevent, NULL);
+		if (ev.type == syncevbase + XSyncAlarmNotify) {
+			syncnotify(&ev);
+			/* the client caught up, give it the latest size */
+			if (pending && !syncwaiting(c)) {
+				resize(c, c->x, c->y, nw, nh, 1);
+				pending = 0;
+			}
+			continue;
+		}
 		switch(ev.type) {
 		case ConfigureRequest:
 		case Expose:
@@ -1426,7 +2068,8 @@ resizemouse(const Arg *arg)
 			handler[ev.type](&ev);
 			break;
 		case MotionNotify:
-			if ((ev.xmotion.time - lasttime) <= (1000 / 60))
+			/* clients with a sync counter are paced by their acks */
+			if (!c->syncalarm && (ev.xmotion.time - lasttime) <= c->mon->frame)
 				continue;
 			lasttime = ev.xmotion.time;
 
@@ -1439,11 +2082,16 @@ resizemouse(const Arg *arg)
 				&& (abs(nw - c->w) > snap || abs(nh - c->h) > snap))
 					togglefloating(NULL);
 			}
-			if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
+			if (!selmon->lt[selmon->sellt]->arrange || c->isfloating) {
+				if ((pending = syncwaiting(c)))
+					break;
 				resize(c, c->x, c->y, nw, nh, 1);
+			}
 			break;
 		}
 	} while (ev.type != ButtonRelease);
+	if (pending)
+		resize(c, c->x, c->y, nw, nh, 1);
 	XWarpPointer(dpy, None, c->win, 0, 0, 0, 0, c->w + c->bw - 1, c->h + c->bw - 1);
 	XUngrabPointer(dpy, CurrentTime);
 	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
@@ -1458,7 +2106,6 @@ void
 restack(Monitor *m)
 {
 	Client *c;
-	XEvent ev;
 	XWindowChanges wc;
 
 	drawbar(m);
@@ -1466,7 +2113,8 @@ restack(Monitor *m)
 		return;
 	if (m->sel->isfloating || !m->lt[m->sellt]->arrange)
 		XRaiseWindow(dpy, m->sel->win);
-	if (m->lt[m->sellt]->arrange) {
+	/* the tiled clients are all below the fullscreen one */
+	if (m->lt[m->sellt]->arrange && !ISFULLSCREEN(m)) {
 		wc.stack_mode = Below;
 		wc.sibling = m->barwin;
 		for (c = m->stack; c; c = c->snext)
@@ -1475,19 +2123,52 @@ restack(Monitor *m)
 				wc.sibling = c->win;
 			}
 	}
-	XSync(dpy, False);
-	while (XCheckMaskEvent(dpy, EnterWindowMask, &ev));
+	/* crossing events caused by the requests so far carry a serial below
+	 * the marker, later ones at least its own; enternotify() tells them
+	 * apart without a round trip */
+	enterserial = NextRequest(dpy);
+	XNoOp(dpy);
 }
 
 void
 run(void)
 {
 	XEvent ev;
+	fd_set rfd;
+	struct timeval tv;
+	long ms, sms;
+	int xfd = ConnectionNumber(dpy);
+
 	/* main event loop */
 	XSync(dpy, False);
-	while (running && !XNextEvent(dpy, &ev))
-		if (handler[ev.type])
-			handler[ev.type](&ev); /* call handler */
+	while (running) {
+		ms = flushbars();
+		if ((sms = flushsync()) >= 0 && (ms < 0 || sms < ms))
+			ms = sms;
+		if (XPending(dpy)) {
+			XNextEvent(dpy, &ev);
+			if (ev.type == syncevbase + XSyncAlarmNotify)
+				syncnotify(&ev);
+			else if (rrevbase >= 0 && (ev.type == rrevbase + RRScreenChangeNotify
+			|| ev.type == rrevbase + RRNotify)) {
+				XRRUpdateConfiguration(&ev);
+				updaterefresh();
+			} else if (handler[ev.type])
+				handler[ev.type](&ev); /* call handler */
+			continue;
+		}
+		/* the queue is drained, wait for X, the status socket,
+		 * pending bar updates or sync timeouts */
+		FD_ZERO(&rfd);
+		FD_SET(xfd, &rfd);
+		if (statusfd >= 0)
+			FD_SET(statusfd, &rfd);
+		tv.tv_sec = ms / 1000;
+		tv.tv_usec = ms % 1000 * 1000;
+		if (select(MAX(xfd, statusfd) + 1, &rfd, NULL, NULL, ms >= 0 ? &tv : NULL) > 0
+		&& statusfd >= 0 && FD_ISSET(statusfd, &rfd))
+			readstatus();
+	}
 }
 
 void
@@ -1498,20 +2179,24 @@ scan(void)
 	XWindowAttributes wa;
 
 	if (XQueryTree(dpy, root, &d1, &d2, &wins, &num)) {
+		/* request everything for all windows before waiting for any */
+		for (i = 0; i < num; i++)
+			prefetch(wins[i]);
 		for (i = 0; i < num; i++) {
-			if (!XGetWindowAttributes(dpy, wins[i], &wa)
-			|| wa.override_redirect || XGetTransientForHint(dpy, wins[i], &d1))
+			if (!getattrs(wins[i], &wa)
+			|| wa.override_redirect || gettransient(wins[i], &d1))
 				continue;
 			if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
 				manage(wins[i], &wa);
 		}
 		for (i = 0; i < num; i++) { /* now the transients */
-			if (!XGetWindowAttributes(dpy, wins[i], &wa))
+			if (!getattrs(wins[i], &wa))
 				continue;
-			if (XGetTransientForHint(dpy, wins[i], &d1)
+			if (gettransient(wins[i], &d1)
 			&& (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
 				manage(wins[i], &wa);
 		}
+		prefetchdone();
 		if (wins)
 			XFree(wins);
 	}
@@ -1533,6 +2218,21 @@ sendmon(Client *c, Monitor *m)
 	arrange(NULL);
 }
 
+/* sets the hint for compositors, or gives the client its own value back */
+void
+setbypass(Client *c, int bypass)
+{
+	long v = bypass ? 1 : c->bypasshint;
+
+	c->isbypassed = bypass;
+	c->bypassserial = NextRequest(dpy);
+	if (v)
+		XChangeProperty(dpy, c->win, netatom[NetWMBypassCompositor], XA_CARDINAL, 32,
+			PropModeReplace, (unsigned char *)&v, 1);
+	else
+		XDeleteProperty(dpy, c->win, netatom[NetWMBypassCompositor]);
+}
+
 void
 setclientstate(Client *c, long state)
 {
@@ -1545,17 +2245,10 @@ setclientstate(Client *c, long state)
 int
 sendevent(Client *c, Atom proto)
 {
-	int n;
-	Atom *protocols;
-	int exists = 0;
+	int exists;
 	XEvent ev;
 
-	if (XGetWMProtocols(dpy, c->win, &protocols, &n)) {
-		while (!exists && n--)
-			exists = protocols[n] == proto;
-		XFree(protocols);
-	}
-	if (exists) {
+	if ((exists = hasprotocol(c, proto))) {
 		ev.type = ClientMessage;
 		ev.xclient.window = c->win;
 		ev.xclient.message_type = wmatom[WMProtocols];
@@ -1592,6 +2285,7 @@ setfullscreen(Client *c, int fullscreen)
 		c->isfloating = 1;
 		resizeclient(c, c->mon->mx, c->mon->my, c->mon->mw, c->mon->mh);
 		XRaiseWindow(dpy, c->win);
+		updatebypass(c->mon);
 	} else if (!fullscreen && c->isfullscreen){
 		XChangeProperty(dpy, c->win, netatom[NetWMState], XA_ATOM, 32,
 			PropModeReplace, (unsigned char*)0, 0);
@@ -1633,16 +2327,20 @@ setmfact(const Arg *arg)
 	if (f < 0.05 || f > 0.95)
 		return;
 	selmon->mfact = selmon->pertag->mfacts[selmon->pertag->curtag] = f;
-	arrange(selmon);
+	if (syncbusy(selmon))
+		selmon->syncarrange = 1; /* see syncnotify() and flushsync() */
+	else
+		arrange(selmon);
 }
 
 void
 setup(void)
 {
-	int i;
+	int i, j;
 	XSetWindowAttributes wa;
 	Atom utf8string;
 	struct sigaction sa;
+	struct sockaddr_un addr;
 
 	/* do not transform children into zombies when they terminate */
 	sigemptyset(&sa.sa_mask);
@@ -1663,7 +2361,18 @@ setup(void)
 		die("no fonts could be loaded.");
 	lrpad = drw->fonts->h;
 	bh = drw->fonts->h + 2;
+	for (i = 0; i < LENGTH(tags); i++)
+		tagw[i] = TEXTW(tags[i]);
 	updategeom();
+	if (!XSyncQueryExtension(dpy, &syncevbase, &i) || !XSyncInitialize(dpy, &i, &j))
+		syncevbase = -1;
+	/* refresh rate changes may keep the geometry, watch the CRTCs */
+	if (XRRQueryExtension(dpy, &rrevbase, &i) && XRRQueryVersion(dpy, &i, &j)
+	&& (i > 1 || (i == 1 && j >= 3)))
+		XRRSelectInput(dpy, root, RRScreenChangeNotifyMask|RRCrtcChangeNotifyMask);
+	else
+		rrevbase = -1;
+	updaterefresh();
 	/* init atoms */
 	utf8string = XInternAtom(dpy, "UTF8_STRING", False);
 	wmatom[WMProtocols] = XInternAtom(dpy, "WM_PROTOCOLS", False);
@@ -1679,6 +2388,21 @@ setup(void)
 	netatom[NetWMWindowType] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
 	netatom[NetWMWindowTypeDialog] = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
 	netatom[NetClientList] = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+	netatom[NetWMSyncRequest] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST", False);
+	netatom[NetWMSyncCounter] = XInternAtom(dpy, "_NET_WM_SYNC_REQUEST_COUNTER", False);
+	netatom[NetWMBypassCompositor] = XInternAtom(dpy, "_NET_WM_BYPASS_COMPOSITOR", False);
+	pfatom[PfNetName] = netatom[NetWMName];
+	pfatom[PfName] = XA_WM_NAME;
+	pfatom[PfTrans] = XA_WM_TRANSIENT_FOR;
+	pfatom[PfClass] = XA_WM_CLASS;
+	pfatom[PfNetState] = netatom[NetWMState];
+	pfatom[PfNetType] = netatom[NetWMWindowType];
+	pfatom[PfNormalHints] = XA_WM_NORMAL_HINTS;
+	pfatom[PfHints] = XA_WM_HINTS;
+	pfatom[PfProtocols] = wmatom[WMProtocols];
+	pfatom[PfState] = wmatom[WMState];
+	pfatom[PfSyncCounter] = netatom[NetWMSyncCounter];
+	pfatom[PfBypass] = netatom[NetWMBypassCompositor];
 	/* init cursors */
 	cursor[CurNormal] = drw_cur_create(drw, XC_left_ptr);
 	cursor[CurResize] = drw_cur_create(drw, XC_sizing);
@@ -1690,6 +2414,21 @@ setup(void)
 	/* init bars */
 	updatebars();
 	updatestatus();
+	/* status socket, see readstatus() */
+	memset(&addr, 0, sizeof addr);
+	addr.sun_family = AF_UNIX;
+	if (statussock && statuspath(addr.sun_path, sizeof addr.sun_path)
+	&& (statusfd = socket(AF_UNIX, SOCK_DGRAM, 0)) >= 0) {
+		unlink(addr.sun_path);
+		if (bind(statusfd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+			fprintf(stderr, "dwm: cannot bind %s: %s\n", addr.sun_path, strerror(errno));
+			close(statusfd);
+			statusfd = -1;
+		} else {
+			chmod(addr.sun_path, 0600);
+			fcntl(statusfd, F_SETFD, FD_CLOEXEC);
+		}
+	}
 	/* supporting window for NetWMCheck */
 	wmcheckwin = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
 	XChangeProperty(dpy, wmcheckwin, netatom[NetWMCheck], XA_WINDOW, 32,
@@ -1733,14 +2472,33 @@ showhide(Client *c)
 		return;
 	if (ISVISIBLE(c)) {
 		/* show clients top down */
-		XMoveWindow(dpy, c->win, c->x, c->y);
+		if (c->isunmapped) {
+			XMapWindow(dpy, c->win);
+			setclientstate(c, NormalState);
+			c->isunmapped = 0;
+		}
+		if (c->ishidden) {
+			XMoveWindow(dpy, c->win, c->x, c->y);
+			c->ishidden = 0;
+		}
 		if ((!c->mon->lt[c->mon->sellt]->arrange || c->isfloating) && !c->isfullscreen)
 			resize(c, c->x, c->y, c->w, c->h, 0);
 		showhide(c->snext);
 	} else {
 		/* hide clients bottom up */
 		showhide(c->snext);
-		XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
+		if (hideunmap && !c->nounmap) {
+			/* unmapped clients can stop rendering */
+			if (!c->isunmapped) {
+				c->ignoreunmap++;
+				XUnmapWindow(dpy, c->win);
+				setclientstate(c, IconicState);
+				c->isunmapped = 1;
+			}
+		} else if (!c->ishidden) {
+			XMoveWindow(dpy, c->win, WIDTH(c) * -2, c->y);
+			c->ishidden = 1;
+		}
 	}
 }
 
@@ -1766,6 +2524,87 @@ spawn(const Arg *arg)
 	}
 }
 
+/* Absolute names are used as they are. Others are placed in the runtime
+ * directory of the user, or $HOME without one, keyed on the display. */
+int
+statuspath(char *buf, size_t size)
+{
+	const char *dir, *d = getenv("DISPLAY");
+	int n;
+
+	if (statussock[0] == '/')
+		n = snprintf(buf, size, "%s", statussock);
+	else if ((dir = getenv("XDG_RUNTIME_DIR")) || (dir = getenv("HOME")))
+		n = snprintf(buf, size, "%s/%s%s", dir, statussock, d ? d : "");
+	else
+		return 0;
+	return n >= 0 && (size_t)n < size;
+}
+
+/* some visible client of m has not acked its last resize yet */
+int
+syncbusy(Monitor *m)
+{
+	Client *c;
+
+	for (c = m->clients; c; c = c->next)
+		if (ISVISIBLE(c) && syncwaiting(c))
+			return 1;
+	return 0;
+}
+
+void
+syncnotify(XEvent *e)
+{
+	XSyncAlarmNotifyEvent *ev = (XSyncAlarmNotifyEvent *)e;
+	int64_t v = (int64_t)XSyncValueHigh32(ev->counter_value) << 32
+		| XSyncValueLow32(ev->counter_value);
+	Client *c;
+	Monitor *m;
+
+	for (m = mons; m; m = m->next)
+		for (c = m->clients; c; c = c->next) {
+			if (c->syncalarm != ev->alarm)
+				continue;
+			if (v >= c->syncvalue || ev->state != XSyncAlarmActive)
+				c->syncpending = 0;
+			if (m->syncarrange && !syncbusy(m))
+				arrange(m);
+			return;
+		}
+}
+
+/* asks c to update its counter once it has redrawn after the next
+ * ConfigureNotify, see _NET_WM_SYNC_REQUEST in the EWMH */
+void
+syncrequest(Client *c)
+{
+	XSyncAlarmAttributes aa;
+	XEvent ev;
+
+	c->syncvalue++;
+	XSyncIntsToValue(&aa.trigger.wait_value, c->syncvalue & 0xffffffff, c->syncvalue >> 32);
+	XSyncChangeAlarm(dpy, c->syncalarm, XSyncCAValue, &aa);
+	ev.type = ClientMessage;
+	ev.xclient.window = c->win;
+	ev.xclient.message_type = wmatom[WMProtocols];
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = netatom[NetWMSyncRequest];
+	ev.xclient.data.l[1] = CurrentTime;
+	ev.xclient.data.l[2] = c->syncvalue & 0xffffffff;
+	ev.xclient.data.l[3] = c->syncvalue >> 32;
+	ev.xclient.data.l[4] = 0;
+	XSendEvent(dpy, c->win, False, NoEventMask, &ev);
+	c->syncpending = 1;
+	c->synctime = mstime();
+}
+
+int
+syncwaiting(Client *c)
+{
+	return c->syncpending && mstime() - c->synctime < SYNCTIMEOUT;
+}
+
 void
 tag(const Arg *arg)
 {
@@ -1912,6 +2751,9 @@ unmanage(Client *c, int destroyed)
 
 	Client *s = swallowingclient(c->win);
 	if (s) {
+		indexdel(&swallowindex, c->win);
+		if (s->swallowing->syncalarm)
+			XSyncDestroyAlarm(dpy, s->swallowing->syncalarm);
 		free(s->swallowing);
 		s->swallowing = NULL;
 		arrange(m);
@@ -1921,6 +2763,9 @@ unmanage(Client *c, int destroyed)
 
 	detach(c);
 	detachstack(c);
+	indexdel(&clientindex, c->win);
+	if (c->syncalarm)
+		XSyncDestroyAlarm(dpy, c->syncalarm);
 	if (!destroyed) {
 		wc.border_width = c->oldbw;
 		XGrabServer(dpy); /* avoid race conditions */
@@ -1928,6 +2773,8 @@ unmanage(Client *c, int destroyed)
 		XSelectInput(dpy, c->win, NoEventMask);
 		XConfigureWindow(dpy, c->win, CWBorderWidth, &wc); /* restore border */
 		XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
+		if (c->isbypassed)
+			setbypass(c, 0);
 		setclientstate(c, WithdrawnState);
 		XSync(dpy, False);
 		XSetErrorHandler(xerror);
@@ -1948,10 +2795,16 @@ unmapnotify(XEvent *e)
 	Client *c;
 	XUnmapEvent *ev = &e->xunmap;
 
+	/* a real unmap is reported to the client window and again to the
+	 * root, only count the first so ignoreunmap is not used up twice */
+	if (!ev->send_event && ev->event != ev->window)
+		return;
 	if ((c = wintoclient(ev->window))) {
-		if (ev->send_event)
+		if (!ev->send_event && c->ignoreunmap)
+			c->ignoreunmap--;
+		else if (ev->send_event && !c->isunmapped)
 			setclientstate(c, WithdrawnState);
-		else
+		else /* a withdrawn window we had unmapped only sends the synthetic event */
 			unmanage(c, 0);
 	}
 }
@@ -1967,6 +2820,13 @@ updatebars(void)
 	};
 	XClassHint ch = {"dwm", "dwm"};
 	for (m = mons; m; m = m->next) {
+		if (m->barpixw != m->ww) {
+			if (m->barpix)
+				XFreePixmap(dpy, m->barpix);
+			m->barpix = XCreatePixmap(dpy, root, m->ww, bh, DefaultDepth(dpy, screen));
+			m->barpixw = m->ww;
+			m->bar.valid = 0;
+		}
 		if (m->barwin)
 			continue;
 		m->barwin = XCreateWindow(dpy, root, m->wx, m->by, m->ww, bh, 0, DefaultDepth(dpy, screen),
@@ -1991,6 +2851,26 @@ updatebarpos(Monitor *m)
 		m->by = -bh;
 }
 
+/* hints compositors to unredirect clients that cover the monitor alone */
+void
+updatebypass(Monitor *m)
+{
+	unsigned int n = 0;
+	int bypass;
+	Client *c;
+
+	for (c = m->clients; c; c = c->next)
+		if (ISVISIBLE(c))
+			n++;
+	for (c = m->clients; c; c = c->next) {
+		/* 2 asks compositors to keep compositing the client */
+		bypass = !c->nobypass && c->bypasshint != 2 && ISVISIBLE(c) && (c->isfullscreen
+			|| (n == 1 && !c->isfloating && m->lt[m->sellt]->arrange == monocle));
+		if (bypass != c->isbypassed)
+			setbypass(c, bypass);
+	}
+}
+
 void
 updateclientlist()
 {
@@ -2099,15 +2979,74 @@ updatenumlockmask(void)
 	XFreeModifiermap(modmap);
 }
 
+/* frame time of every monitor from the fastest output it shows,
+ * 60 Hz where RandR 1.3 is missing or does not tell */
+void
+updaterefresh(void)
+{
+	XRRScreenResources *sr;
+	XRRCrtcInfo *ci;
+	XRRModeInfo *mi;
+	Monitor *m;
+	int i, j, ms;
+
+	for (m = mons; m; m = m->next)
+		m->frame = 0;
+	if (rrevbase >= 0 && (sr = XRRGetScreenResourcesCurrent(dpy, root))) {
+		for (i = 0; i < sr->ncrtc; i++) {
+			if (!(ci = XRRGetCrtcInfo(dpy, sr, sr->crtcs[i])))
+				continue;
+			for (j = 0; ci->mode && j < sr->nmode; j++) {
+				mi = &sr->modes[j];
+				if (mi->id != ci->mode || !mi->hTotal || !mi->vTotal || !mi->dotClock)
+					continue;
+				ms = MAX(1000.0 * mi->hTotal * mi->vTotal / mi->dotClock, 1);
+				for (m = mons; m; m = m->next)
+					if (ci->x < m->mx + m->mw && m->mx < ci->x + (int)ci->width
+					&& ci->y < m->my + m->mh && m->my < ci->y + (int)ci->height
+					&& (!m->frame || ms < m->frame))
+						m->frame = ms;
+			}
+			XRRFreeCrtcInfo(ci);
+		}
+		XRRFreeScreenResources(sr);
+	}
+	for (m = mons; m; m = m->next)
+		if (!m->frame)
+			m->frame = 1000 / 60;
+}
+
 void
 updatesizehints(Client *c)
 {
-	long msize;
-	XSizeHints size;
+	XSizeHints size = { 0 };
+	xcb_get_property_reply_t *p;
+	uint32_t *v;
+	int n;
 
-	if (!XGetWMNormalHints(dpy, c->win, &size, &msize))
+	if ((p = getprop(c->win, XA_WM_NORMAL_HINTS)) && p->type == XA_WM_SIZE_HINTS
+	&& p->format == 32 && (n = xcb_get_property_value_length(p) / 4) >= 15) {
+		v = xcb_get_property_value(p);
+		size.flags = v[0];
+		size.min_width = (int32_t)v[5];
+		size.min_height = (int32_t)v[6];
+		size.max_width = (int32_t)v[7];
+		size.max_height = (int32_t)v[8];
+		size.width_inc = (int32_t)v[9];
+		size.height_inc = (int32_t)v[10];
+		size.min_aspect.x = (int32_t)v[11];
+		size.min_aspect.y = (int32_t)v[12];
+		size.max_aspect.x = (int32_t)v[13];
+		size.max_aspect.y = (int32_t)v[14];
+		if (n >= 17) {
+			size.base_width = (int32_t)v[15];
+			size.base_height = (int32_t)v[16];
+		} else /* pre ICCCM 1 hints have no base size */
+			size.flags &= ~PBaseSize;
+	} else
 		/* size is uninitialized, ensure that size.flags aren't used */
 		size.flags = PSize;
+	free(p);
 	if (size.flags & PBaseSize) {
 		c->basew = size.base_width;
 		c->baseh = size.base_height;
@@ -2151,6 +3090,35 @@ updatestatus(void)
 	drawbar(selmon);
 }
 
+/* watches the sync counter of clients supporting _NET_WM_SYNC_REQUEST */
+void
+updatesync(Client *c)
+{
+	XSyncAlarmAttributes aa;
+	xcb_get_property_reply_t *p;
+
+	if (c->syncalarm)
+		XSyncDestroyAlarm(dpy, c->syncalarm);
+	c->syncalarm = None;
+	c->syncpending = 0;
+	if (syncevbase < 0 || !hasprotocol(c, netatom[NetWMSyncRequest]))
+		return;
+	if ((p = getprop(c->win, netatom[NetWMSyncCounter])) && p->type == XA_CARDINAL
+	&& p->format == 32 && xcb_get_property_value_length(p) >= 4) {
+		c->syncvalue = 0;
+		aa.trigger.counter = *(uint32_t *)xcb_get_property_value(p);
+		aa.trigger.value_type = XSyncAbsolute;
+		aa.trigger.test_type = XSyncPositiveComparison;
+		XSyncIntToValue(&aa.trigger.wait_value, 0);
+		XSyncIntToValue(&aa.delta, 1);
+		aa.events = True;
+		XSyncSetCounter(dpy, aa.trigger.counter, aa.trigger.wait_value);
+		c->syncalarm = XSyncCreateAlarm(dpy, XSyncCACounter|XSyncCAValueType
+			|XSyncCATestType|XSyncCAValue|XSyncCADelta|XSyncCAEvents, &aa);
+	}
+	free(p);
+}
+
 void
 updatetitle(Client *c)
 {
@@ -2175,20 +3143,36 @@ updatewindowtype(Client *c)
 void
 updatewmhints(Client *c)
 {
-	XWMHints *wmh;
+	XWMHints wmh;
+	xcb_get_property_reply_t *p;
+	uint32_t *v;
+	int n;
 
-	if ((wmh = XGetWMHints(dpy, c->win))) {
-		if (c == selmon->sel && wmh->flags & XUrgencyHint) {
-			wmh->flags &= ~XUrgencyHint;
-			XSetWMHints(dpy, c->win, wmh);
+	if ((p = getprop(c->win, XA_WM_HINTS)) && p->type == XA_WM_HINTS
+	&& p->format == 32 && (n = xcb_get_property_value_length(p) / 4) >= 8) {
+		v = xcb_get_property_value(p);
+		wmh.flags = v[0];
+		wmh.input = v[1];
+		wmh.initial_state = v[2];
+		wmh.icon_pixmap = v[3];
+		wmh.icon_window = v[4];
+		wmh.icon_x = (int32_t)v[5];
+		wmh.icon_y = (int32_t)v[6];
+		wmh.icon_mask = v[7];
+		wmh.window_group = n >= 9 ? v[8] : None;
+		if (n < 9)
+			wmh.flags &= ~WindowGroupHint;
+		if (c == selmon->sel && wmh.flags & XUrgencyHint) {
+			wmh.flags &= ~XUrgencyHint;
+			XSetWMHints(dpy, c->win, &wmh);
 		} else
-			c->isurgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
-		if (wmh->flags & InputHint)
-			c->neverfocus = !wmh->input;
+			c->isurgent = (wmh.flags & XUrgencyHint) ? 1 : 0;
+		if (wmh.flags & InputHint)
+			c->neverfocus = !wmh.input;
 		else
 			c->neverfocus = 0;
-		XFree(wmh);
 	}
+	free(p);
 }
 
 void
@@ -2240,9 +3224,14 @@ winpid(Window w)
 	spec.client = w;
 	spec.mask = XCB_RES_CLIENT_ID_MASK_LOCAL_CLIENT_PID;
 
-	xcb_generic_error_t *e = NULL;
-	xcb_res_query_client_ids_cookie_t c = xcb_res_query_client_ids(xcon, 1, &spec);
-	xcb_res_query_client_ids_reply_t *r = xcb_res_query_client_ids_reply(xcon, c, &e);
+	Prefetch *pf = pfget(w);
+	xcb_res_query_client_ids_cookie_t c;
+	if (pf && !pf->pidfetched) {
+		c = pf->pidck;
+		pf->pidfetched = 1;
+	} else
+		c = xcb_res_query_client_ids(xcon, 1, &spec);
+	xcb_res_query_client_ids_reply_t *r = xcb_res_query_client_ids_reply(xcon, c, NULL);
 
 	if (!r)
 		return (pid_t)0;
@@ -2309,34 +3298,36 @@ getparentprocess(pid_t p)
 		return 0;
 
 	kp = kvm_getprocs(kd, KERN_PROC_PID, p, sizeof(*kp), &n);
-	v = kp->p_ppid;
+	if (kp && n > 0)
+		v = kp->p_ppid;
+	kvm_close(kd);
 #endif /* __OpenBSD__ */
 
 	return (pid_t)v;
 }
 
-int
-isdescprocess(pid_t p, pid_t c)
-{
-	while (p != c && c != 0)
-		c = getparentprocess(c);
-
-	return (int)c;
-}
-
 Client *
 termforwin(const Client *w)
 {
 	Client *c;
 	Monitor *m;
+	pid_t p, anc[64];
+	int i, n;
 
 	if (!w->pid || w->isterminal)
 		return NULL;
 
+	/* the ancestors of w are the same for every terminal, read them once */
+	for (n = 0, p = w->pid; p && n < LENGTH(anc); p = getparentprocess(p))
+		anc[n++] = p;
+
 	for (m = mons; m; m = m->next) {
 		for (c = m->clients; c; c = c->next) {
-			if (c->isterminal && !c->swallowing && c->pid && isdescprocess(c->pid, w->pid))
-				return c;
+			if (!c->isterminal || c->swallowing || !c->pid)
+				continue;
+			for (i = 0; i < n; i++)
+				if (anc[i] == c->pid)
+					return c;
 		}
 	}
 
@@ -2346,30 +3337,13 @@ termforwin(const Client *w)
 Client *
 swallowingclient(Window w)
 {
-	Client *c;
-	Monitor *m;
-
-	for (m = mons; m; m = m->next) {
-		for (c = m->clients; c; c = c->next) {
-			if (c->swallowing && c->swallowing->win == w)
-				return c;
-		}
-	}
-
-	return NULL;
+	return indexget(&swallowindex, w);
 }
 
 Client *
 wintoclient(Window w)
 {
-	Client *c;
-	Monitor *m;
-
-	for (m = mons; m; m = m->next)
-		for (c = m->clients; c; c = c->next)
-			if (c->win == w)
-				return c;
-	return NULL;
+	return indexget(&clientindex, w);
 }
 
 Monitor *
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <X11/Xlib.h>
 
 #include "arg.h"
@@ -20,6 +23,8 @@ struct arg {
 char buf[1024];
 static int done;
 static Display *dpy;
+static int sockfd = -1;
+static struct sockaddr_un sockaddr;
 
 #include "config.h"
 
@@ -39,10 +44,48 @@ difftimespec(struct timespec *res, struct timespec *a, struct timespec *b)
 	               (a->tv_nsec < b->tv_nsec) * 1E9;
 }
 
+/* the path dwm(1) binds its relative statussock name to */
+static int
+sockpath(char *path, size_t size, const char *name)
+{
+	const char *dir, *d = getenv("DISPLAY");
+	int n;
+
+	if (name[0] == '/') {
+		n = snprintf(path, size, "%s", name);
+	} else if ((dir = getenv("XDG_RUNTIME_DIR")) || (dir = getenv("HOME"))) {
+		n = snprintf(path, size, "%s/%s%s", dir, name, d ? d : "");
+	} else {
+		return 0;
+	}
+
+	return n >= 0 && (size_t)n < size;
+}
+
 static void
 usage(void)
 {
-	die("usage: %s [-s]", argv0);
+	die("usage: %s [-s] [-u socket]", argv0);
+}
+
+/* send block i to the status socket unless it did not change */
+static void
+sendblock(size_t i, const char *text, int force)
+{
+	static char prev[LEN(args)][MAXLEN];
+	static int sent[LEN(args)];
+	char msg[MAXLEN + 16];
+	int len;
+
+	if (!force && sent[i] && !strcmp(prev[i], text)) {
+		return;
+	}
+	if ((len = esnprintf(msg, sizeof(msg), "%zu %s", i, text)) < 0) {
+		return;
+	}
+	sent[i] = sendto(sockfd, msg, len, 0, (struct sockaddr *)&sockaddr,
+	                 sizeof(sockaddr)) == len;
+	strcpy(prev[i], text);
 }
 
 int
@@ -52,14 +95,20 @@ main(int argc, char *argv[])
 	struct timespec start, current, diff, intspec, wait;
 	size_t i, len;
 	int sflag, ret;
-	char status[MAXLEN];
-	const char *res;
+	char status[MAXLEN], block[MAXLEN];
+	const char *res, *sock;
+	time_t lastall;
 
 	sflag = 0;
+	sock = NULL;
+	lastall = 0;
 	ARGBEGIN {
 		case 's':
 			sflag = 1;
 			break;
+		case 'u':
+			sock = EARGF(usage());
+			break;
 		default:
 			usage();
 	} ARGEND
@@ -73,7 +122,15 @@ main(int argc, char *argv[])
 	sigaction(SIGINT,  &act, NULL);
 	sigaction(SIGTERM, &act, NULL);
 
-	if (!sflag && !(dpy = XOpenDisplay(NULL))) {
+	if (sock) {
+		sockaddr.sun_family = AF_UNIX;
+		if (!sockpath(sockaddr.sun_path, sizeof(sockaddr.sun_path), sock)) {
+			die("%s: Cannot make a socket path", sock);
+		}
+		if ((sockfd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+			die("socket:");
+		}
+	} else if (!sflag && !(dpy = XOpenDisplay(NULL))) {
 		die("XOpenDisplay: Failed to open display");
 	}
 
@@ -87,6 +144,18 @@ main(int argc, char *argv[])
 			if (!(res = args[i].func(args[i].args))) {
 				res = unknown_str;
 			}
+			if (sock) {
+				/*
+				 * resend all blocks now and then for a
+				 * restarted window manager
+				 */
+				if (esnprintf(block, sizeof(block), args[i].fmt,
+				              res) >= 0) {
+					sendblock(i, block,
+					          start.tv_sec - lastall >= 10);
+				}
+				continue;
+			}
 			if ((ret = esnprintf(status + len, sizeof(status) - len,
 			                    args[i].fmt, res)) < 0) {
 				break;
@@ -94,7 +163,11 @@ main(int argc, char *argv[])
 			len += ret;
 		}
 
-		if (sflag) {
+		if (sock) {
+			if (start.tv_sec - lastall >= 10) {
+				lastall = start.tv_sec;
+			}
+		} else if (sflag) {
 			puts(status);
 			fflush(stdout);
 			if (ferror(stdout))
@@ -126,7 +199,12 @@ main(int argc, char *argv[])
 		}
 	}
 
-	if (!sflag) {
+	if (sock) {
+		for (i = 0; i < LEN(args); i++) {
+			sendblock(i, "", 1);
+		}
+		close(sockfd);
+	} else if (!sflag) {
 		XStoreName(dpy, DefaultRootWindow(dpy), NULL);
 		if (XCloseDisplay(dpy) < 0) {
 			die("XCloseDisplay: Failed to close display");
@@ -47,6 +47,12 @@ int allowaltscreen = 1;
    setting the clipboard text */
 int allowwindowops = 0;
 
+/*
+ * longest string sequence (OSC, DCS, ...) in bytes, longer ones are dropped.
+ * OSC 52 clipboard data is decoded as it arrives and counts decoded.
+ */
+unsigned int maxstrlen = 4 << 20;
+
 /*
  * draw latency range in ms - from new content/keypress/etc until drawing.
  * within this range, st draws when content stops arriving (idle). mostly it's
@@ -56,12 +62,39 @@ int allowwindowops = 0;
 static double minlatency = 8;
 static double maxlatency = 33;
 
+/*
+ * tty parse budget in ms per frame (set to 0 to disable). once a frame spent
+ * this long parsing output, st stops reading the tty until the frame is
+ * drawn. runaway producers are then blocked by the kernel instead of keeping
+ * st busy, and keyboard input stays responsive.
+ */
+static double ttybudget = 15;
+
+/*
+ * Synchronized-Update timeout in ms
+ * https://gitlab.com/gnachman/iterm2/-/wikis/synchronized-updates-spec
+ */
+static uint su_timeout = 200;
+
+/*
+ * use a MIT-SHM pixmap as back buffer when the X server is local and st was
+ * built with XSHM (see config.mk).
+ */
+static int useshm = 1;
+
 /*
  * blinking timeout (set to 0 to disable blinking) for the terminal blinking
  * attribute.
  */
 static unsigned int blinktimeout = 800;
 
+/*
+ * idle memory compaction (in seconds, set to 0 to disable): after this long
+ * without output the scrollback is packed and the unused alternate screen is
+ * freed until the terminal is used again.
+ */
+static unsigned int compacttimeout = 60;
+
 /*
  * thickness of underline and bar cursors
  */
@@ -162,6 +195,13 @@ static unsigned int defaultattr = 11;
  */
 static uint forcemousemod = ShiftMask;
 
+/*
+ * Clicking Button1 with linkmask held opens the OSC 8 hyperlink or the URL
+ * under the pointer with linkopener.
+ */
+static uint linkmask = ControlMask;
+static char *linkopener = "xdg-open";
+
 /*
  * Internal mouse shortcuts.
  * Beware that overloading Button1 will disable the selection.
@@ -186,6 +226,8 @@ static Shortcut shortcuts[] = {
 	{ XK_ANY_MOD,           XK_Break,       sendbreak,      {.i =  0} },
 	{ ControlMask,          XK_Print,       toggleprinter,  {.i =  0} },
 	{ ShiftMask,            XK_Print,       printscreen,    {.i =  0} },
+	{ MODKEY,               XK_Print,       exporthist,     {.s = NULL} },
+	{ MODKEY|ShiftMask,     XK_Print,       exporthistsgr,  {.s = NULL} },
 	{ XK_ANY_MOD,           XK_Print,       printsel,       {.i =  0} },
 	{ TERMMOD,              XK_Prior,       zoom,           {.f = +1} },
 	{ TERMMOD,              XK_Next,        zoom,           {.f = -1} },
@@ -195,6 +237,8 @@ static Shortcut shortcuts[] = {
 	{ TERMMOD,              XK_Y,           selpaste,       {.i =  0} },
 	{ ShiftMask,            XK_Insert,      selpaste,       {.i =  0} },
 	{ TERMMOD,              XK_Num_Lock,    numlock,        {.i =  0} },
+	{ TERMMOD,              XK_R,           togglerecord,   {.s = "st.rec"} },
+	{ TERMMOD,              XK_L,           latreport,      {.i =  0} },
 	{ ShiftMask,            XK_Page_Up,     kscrollup,      {.i = -1} },
 	{ ShiftMask,            XK_Page_Down,   kscrolldown,    {.i = -1} },
 };
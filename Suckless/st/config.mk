@@ -12,21 +12,31 @@ X11LIB = /usr/X11R6/lib
 
 PKG_CONFIG = pkg-config
 
+# MIT-SHM back buffer, comment if you don't want it
+SHMLIBS = -lXext
+SHMFLAGS = -DXSHM
+
+# HarfBuzz text shaping (ligatures), uncomment to enable
+#HBSRC = hb.c
+#HBINC = `$(PKG_CONFIG) --cflags harfbuzz`
+#HBLIBS = `$(PKG_CONFIG) --libs harfbuzz`
+#HBFLAGS = -DHARFBUZZ
+
 # includes and libs
 INCS = -I$(X11INC) \
        `$(PKG_CONFIG) --cflags fontconfig` \
-       `$(PKG_CONFIG) --cflags freetype2`
-LIBS = -L$(X11LIB) -lm -lrt -lX11 -lutil -lXft \
+       `$(PKG_CONFIG) --cflags freetype2` $(HBINC)
+LIBS = -L$(X11LIB) -lm -lrt -lpthread -lX11 -lutil -lXft $(SHMLIBS) $(HBLIBS) \
        `$(PKG_CONFIG) --libs fontconfig` \
        `$(PKG_CONFIG) --libs freetype2`
 
 # flags
-STCPPFLAGS = -DVERSION=\"$(VERSION)\" -D_XOPEN_SOURCE=600
+STCPPFLAGS = -DVERSION=\"$(VERSION)\" -D_XOPEN_SOURCE=700 $(SHMFLAGS) $(HBFLAGS)
 STCFLAGS = $(INCS) $(STCPPFLAGS) $(CPPFLAGS) $(CFLAGS)
 STLDFLAGS = $(LIBS) $(LDFLAGS)
 
 # OpenBSD:
-#CPPFLAGS = -DVERSION=\"$(VERSION)\" -D_XOPEN_SOURCE=600 -D_BSD_SOURCE
+#CPPFLAGS = -DVERSION=\"$(VERSION)\" -D_XOPEN_SOURCE=700 -D_BSD_SOURCE
 #LIBS = -L$(X11LIB) -lm -lX11 -lutil -lXft \
 #       `$(PKG_CONFIG) --libs fontconfig` \
 #       `$(PKG_CONFIG) --libs freetype2`
@@ -0,0 +1,163 @@
+/* See LICENSE for license details. */
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xft/Xft.h>
+#include <hb.h>
+#include <hb-ft.h>
+
+#include "st.h"
+#include "hb.h"
+
+/* shaped runs kept, must be a power of two */
+#define HBCACHESIZ	256
+
+typedef struct {
+	XftFont *match;
+	hb_font_t *font;
+} HbFontMatch;
+
+/* shaping result of one run of glyphs drawn with the same font */
+typedef struct {
+	XftFont *match;
+	uint32_t hash;
+	int len;
+	Rune *runes;
+	FT_UInt *glyphs; /* glyph shown in each cell of the run */
+} HbRun;
+
+static hb_font_t *hbfindfont(XftFont *);
+static HbRun *hblookup(XftFont *, const Rune *, int);
+static void hbshape(HbRun *);
+
+static HbFontMatch *hbfonts;
+static int hbfontslen;
+static int hbfontscap;
+static HbRun hbcache[HBCACHESIZ];
+static hb_buffer_t *hbbuf;
+
+hb_font_t *
+hbfindfont(XftFont *match)
+{
+	FT_Face face;
+	int i;
+
+	for (i = 0; i < hbfontslen; i++) {
+		if (hbfonts[i].match == match)
+			return hbfonts[i].font;
+	}
+
+	if (hbfontslen >= hbfontscap) {
+		hbfontscap += 16;
+		hbfonts = xrealloc(hbfonts, hbfontscap * sizeof(*hbfonts));
+	}
+
+	/* the face stays locked as long as the HarfBuzz font uses it */
+	face = XftLockFace(match);
+	hbfonts[hbfontslen].match = match;
+	hbfonts[hbfontslen].font = hb_ft_font_create(face, NULL);
+
+	return hbfonts[hbfontslen++].font;
+}
+
+/*
+ * Fonts are closed on zoom and their addresses reused, so drop every
+ * HarfBuzz font together with the runs shaped with them. This has to
+ * happen before the Xft fonts are closed.
+ */
+void
+hbunloadfonts(void)
+{
+	int i;
+
+	for (i = 0; i < hbfontslen; i++) {
+		hb_font_destroy(hbfonts[i].font);
+		XftUnlockFace(hbfonts[i].match);
+	}
+	hbfontslen = 0;
+
+	for (i = 0; i < HBCACHESIZ; i++)
+		hbcache[i].match = NULL;
+}
+
+void
+hbshape(HbRun *run)
+{
+	hb_font_t *font = hbfindfont(run->match);
+	hb_glyph_info_t *info;
+	hb_codepoint_t space;
+	unsigned int i, n;
+
+	if (!hbbuf)
+		hbbuf = hb_buffer_create();
+	hb_buffer_clear_contents(hbbuf);
+	hb_buffer_add_utf32(hbbuf, (const uint32_t *)run->runes, run->len,
+			0, run->len);
+	hb_buffer_guess_segment_properties(hbbuf);
+	hb_shape(font, hbbuf, NULL, 0);
+	info = hb_buffer_get_glyph_infos(hbbuf, &n);
+
+	/* cells swallowed by a ligature stay blank */
+	if (!hb_font_get_nominal_glyph(font, ' ', &space))
+		space = 0;
+	for (i = 0; i < run->len; i++)
+		run->glyphs[i] = space;
+
+	/* the first glyph of a cluster is drawn in the cluster's first cell */
+	for (i = n; i-- > 0; ) {
+		if (info[i].cluster < run->len)
+			run->glyphs[info[i].cluster] = info[i].codepoint;
+	}
+}
+
+HbRun *
+hblookup(XftFont *match, const Rune *runes, int len)
+{
+	uint32_t h = 2166136261u ^ (uint32_t)(uintptr_t)match;
+	HbRun *run;
+	int i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ runes[i]) * 16777619u;
+
+	run = &hbcache[h & (HBCACHESIZ - 1)];
+	if (run->match == match && run->hash == h && run->len == len &&
+	    !memcmp(run->runes, runes, len * sizeof(Rune)))
+		return run;
+
+	if (run->len < len || !run->runes) {
+		run->runes = xrealloc(run->runes, len * sizeof(Rune));
+		run->glyphs = xrealloc(run->glyphs, len * sizeof(FT_UInt));
+	}
+	memcpy(run->runes, runes, len * sizeof(Rune));
+	run->match = match;
+	run->hash = h;
+	run->len = len;
+	hbshape(run);
+
+	return run;
+}
+
+/*
+ * Replace the glyphs of each run of specs sharing a font by the shaped
+ * ones. runes holds the character of every spec. Runs are looked up in the
+ * cache first, so unchanged lines (prompts, status lines) are not reshaped.
+ */
+void
+hbtransform(XftGlyphFontSpec *specs, const Rune *runes, int len)
+{
+	HbRun *run;
+	int start, end, i;
+
+	for (start = 0; start < len; start = end) {
+		for (end = start + 1; end < len &&
+		     specs[end].font == specs[start].font; end++)
+			;
+		/* a single glyph has nothing to combine with */
+		if (end - start < 2)
+			continue;
+
+		run = hblookup(specs[start].font, &runes[start], end - start);
+		for (i = start; i < end; i++)
+			specs[i].glyph = run->glyphs[i - start];
+	}
+}
@@ -0,0 +1,5 @@
+/* See LICENSE for license details. */
+#include <X11/Xft/Xft.h>
+
+void hbtransform(XftGlyphFontSpec *, const Rune *, int);
+void hbunloadfonts(void);
@@ -0,0 +1,120 @@
+/* See LICENSE for license details. */
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arg.h"
+
+char *argv0;
+
+static void
+die(const char *errstr, ...)
+{
+	va_list ap;
+
+	va_start(ap, errstr);
+	vfprintf(stderr, errstr, ap);
+	va_end(ap);
+	exit(1);
+}
+
+static void
+usage(void)
+{
+	die("usage: %s [-f] [-i] [-s speed] file\n", argv0);
+}
+
+/* sleep until ts seconds after start, scaled by speed */
+static void
+waituntil(const struct timespec *start, double ts, double speed)
+{
+	struct timespec now, d;
+	double left;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	left = ts / speed - ((now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) / 1E9);
+	if (left <= 0)
+		return;
+	d.tv_sec = (time_t)left;
+	d.tv_nsec = (left - d.tv_sec) * 1E9;
+	while (nanosleep(&d, &d) < 0 && errno == EINTR)
+		;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct timespec start;
+	FILE *fp;
+	char *buf = NULL, type;
+	size_t bufsiz = 0, n;
+	double ts, last = 0, speed = 1;
+	int fast = 0, info = 0, col, row, xp, yp;
+
+	ARGBEGIN {
+	case 'f':
+		fast = 1;
+		break;
+	case 'i':
+		info = 1;
+		break;
+	case 's':
+		if ((speed = atof(EARGF(usage()))) <= 0)
+			usage();
+		break;
+	default:
+		usage();
+	} ARGEND;
+
+	if (argc != 1)
+		usage();
+	if (!(fp = fopen(argv[0], "r")))
+		die("%s: %s\n", argv[0], strerror(errno));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (fscanf(fp, " %c %lf", &type, &ts) == 2) {
+		/* appended recordings each start their clock at 0 */
+		if (ts < last)
+			clock_gettime(CLOCK_MONOTONIC, &start);
+		last = ts;
+
+		switch (type) {
+		case 'd':
+			if (fscanf(fp, " %zu", &n) != 1 || fgetc(fp) != '\n')
+				die("%s: bad data record\n", argv[0]);
+			if (n > bufsiz && !(buf = realloc(buf, bufsiz = n)))
+				die("realloc: %s\n", strerror(errno));
+			if (fread(buf, 1, n, fp) != n)
+				die("%s: truncated data record\n", argv[0]);
+			if (!fast)
+				waituntil(&start, ts, speed);
+			/* keep the recorded read() boundaries */
+			if (fwrite(buf, 1, n, stdout) != n || fflush(stdout))
+				die("write: %s\n", strerror(errno));
+			break;
+		case 'r':
+			if (fscanf(fp, " %d %d %d %d", &col, &row, &xp, &yp) != 4)
+				die("%s: bad size record\n", argv[0]);
+			/*
+			 * The window cannot be resized from inside it, start
+			 * st with the recorded geometry instead.
+			 */
+			if (info) {
+				printf("%dx%d\n", col, row);
+				return 0;
+			}
+			break;
+		default:
+			die("%s: unknown record '%c'\n", argv[0], type);
+		}
+	}
+	if (ferror(fp))
+		die("%s: %s\n", argv[0], strerror(errno));
+
+	return 0;
+}
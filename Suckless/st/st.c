@@ -3,6 +3,10 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <pthread.h>
 #include <pwd.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -14,6 +18,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 #include <wchar.h>
 
@@ -36,6 +41,7 @@
 #define STR_BUF_SIZ   ESC_BUF_SIZ
 #define STR_ARG_SIZ   ESC_ARG_SIZ
 #define HISTSIZE      2000
+#define URI_MAX       2083 /* longer OSC 8 targets are ignored */
 
 /* macros */
 #define IS_SET(flag)		((term.mode & (flag)) != 0)
@@ -46,6 +52,11 @@
 #define TLINE(y)		((y) < term.scr ? term.hist[((y) + term.histi - \
 				term.scr + HISTSIZE + 1) % HISTSIZE] : \
 				term.line[(y) - term.scr])
+/*
+ * Lines have a spare glyph past term.col whose u holds the used length of
+ * the line: all cells from there on are blank.
+ */
+#define LINEUSED(l)		((l)[term.col].u)
 
 enum term_mode {
 	MODE_WRAP        = 1 << 0,
@@ -113,6 +124,15 @@ typedef struct {
 	int alt;
 } Selection;
 
+/* Run of glyphs sharing attributes in a packed line, see tpackline() */
+typedef struct {
+	ushort mode;
+	ushort n;     /* number of glyphs, 0 terminates the line */
+	ushort link;
+	uint32_t fg;
+	uint32_t bg;
+} PackedRun;
+
 /* Internal representation of the screen */
 typedef struct {
 	int row;      /* nb row */
@@ -120,10 +140,20 @@ typedef struct {
 	Line *line;   /* screen */
 	Line *alt;    /* alternate screen */
 	Line hist[HISTSIZE]; /* history buffer */
+	char *phist[HISTSIZE]; /* packed history buffer while compacted */
+	int compact;  /* history is packed and the unused alt screen freed */
 	int histi;    /* history index */
 	int scr;      /* scroll back */
 	int *dirty;   /* dirtyness of lines */
+	int *blink;   /* blinking cells per line */
+	int *altblink; /* blinking cells per line of the alternate screen */
+	int nblink;   /* blinking cells on screen */
+	int altnblink; /* blinking cells on the alternate screen */
+	int pscroll;  /* pending whole screen scroll not yet drawn, in lines */
+	ushort **url; /* plain text URLs of each line, see turlline() */
+	int *urlok;   /* url of the line is up to date */
 	TCursor c;    /* cursor */
+	TCursor sc[2]; /* saved cursors of both screens, see tcursor() */
 	int ocx;      /* old cursor col */
 	int ocy;      /* old cursor row */
 	int top;      /* top    scroll limit */
@@ -148,6 +178,24 @@ typedef struct {
 	char mode[2];
 } CSIEscape;
 
+/* Lines of the scrollback encoded by one thread, see texport() */
+typedef struct {
+	Line *lines;
+	int n;
+	int sgr;               /* keep attributes as SGR sequences */
+	char *buf;
+	size_t len, siz;
+	pthread_t thread;
+	int threaded;          /* encoded by thread, not yet joined */
+} ExportChunk;
+
+/* Incremental base64 decoder, see base64dec() */
+typedef struct {
+	int d[4];              /* digits of the current quantum */
+	int n;                 /* nb of digits */
+	int end;               /* padding or invalid input seen */
+} Base64;
+
 /* STR Escape sequence structs */
 /* ESC type [[ [<priv>] <arg> [;]] <mode>] ESC '\' */
 typedef struct {
@@ -157,12 +205,27 @@ typedef struct {
 	size_t len;            /* raw string length */
 	char *args[STR_ARG_SIZ];
 	int narg;              /* nb of args */
+	size_t b64;            /* OSC 52 data decoded into buf from here, or 0 */
+	Base64 dec;            /* OSC 52 decoder state */
+	int drop;              /* longer than maxstrlen, ignored */
 } STREscape;
 
 static void execsh(char *, char **);
 static void stty(char **);
 static void sigchld(int);
 static void ttywriteraw(const char *, size_t);
+static void recflush(void);
+static void recwrite(const char *, size_t);
+static int recheader(char *, size_t, int);
+static void recchunk(const char *, size_t);
+static void recsize(void);
+static int tlinkid(const char *);
+static int tlinkslot(void);
+static void tlinkwalk(void (*)(ushort *));
+static void tlinkmark(ushort *);
+static void tlinkunref(ushort *);
+static int isurlchar(Rune);
+static ushort *turlline(int);
 
 static void csidump(void);
 static void csihandle(void);
@@ -179,6 +242,9 @@ static void tprinter(char *, size_t);
 static void tdumpsel(void);
 static void tdumpline(int);
 static void tdump(void);
+static void *texportchunk(void *);
+static size_t texportsgr(char *, const Glyph *);
+static void texport(const char *, int);
 static void tclearregion(int, int, int, int);
 static void tcursor(int);
 static void tdeletechar(int);
@@ -194,9 +260,12 @@ static void tputc(Rune);
 static void treset(void);
 static void tscrollup(int, int, int);
 static void tscrolldown(int, int, int);
+static void tscrollpixels(int);
 static void tsetattr(const int *, int);
 static void tsetchar(Rune, const Glyph *, int, int);
 static void tsetdirt(int, int);
+static int tblinkcount(const Glyph *);
+static void tblinkline(int);
 static void tsetscroll(int, int);
 static void tswapscreen(void);
 static void tsetmode(int, int, const int *, int);
@@ -204,10 +273,15 @@ static int twrite(const char *, int, int);
 static void tfulldirt(void);
 static void tcontrolcode(uchar );
 static void tdectest(char );
+static char *tpackline(const Glyph *);
+static Line tunpackline(const char *);
+static void texpand(void);
 static void tdefutf8(char);
 static int32_t tdefcolor(const int *, int *, int);
 static void tdeftran(char);
 static void tstrsequence(uchar);
+static void tsync_begin(void);
+static void tsync_end(void);
 
 static void drawregion(int, int, int, int);
 
@@ -220,8 +294,9 @@ static Rune utf8decodebyte(char, size_t *);
 static char utf8encodebyte(Rune, size_t);
 static size_t utf8validate(Rune *, size_t);
 
-static char *base64dec(const char *);
-static char base64dec_getc(const char **);
+static size_t base64dec(char *, const char *, size_t, Base64 *);
+static size_t base64end(char *, Base64 *);
+static size_t base64quantum(char *, Base64 *);
 
 static ssize_t xwrite(int, const char *, size_t);
 
@@ -234,6 +309,23 @@ static int iofd = 1;
 static int cmdfd;
 static pid_t pid;
 
+/* pty transcript, see ttyrecord() */
+static int recfd = -1;
+static char *recpath;
+static char recbuf[1 << 16];
+static size_t reclen;
+static struct timespec recstart;
+static int recw, rech;
+
+/* OSC 8 hyperlink targets indexed by Glyph.link, links[0] is unused */
+static char **links;
+static int linksiz;
+static int linki;
+static uchar *linkused; /* see tlinkmark() */
+static ushort linkdrop; /* see tlinkunref() */
+static int su;                /* synchronized update in progress */
+static struct timespec sutv;  /* synchronized update start time */
+
 static const uchar utfbyte[UTF_SIZ + 1] = {0x80,    0, 0xC0, 0xE0, 0xF0};
 static const uchar utfmask[UTF_SIZ + 1] = {0xC0, 0x80, 0xE0, 0xF0, 0xF8};
 static const Rune utfmin[UTF_SIZ + 1] = {       0,    0,  0x80,  0x800,  0x10000};
@@ -357,19 +449,39 @@ utf8validate(Rune *u, size_t i)
 	return i;
 }
 
-char
-base64dec_getc(const char **src)
+size_t
+base64quantum(char *dst, Base64 *b64)
 {
-	while (**src && !isprint((unsigned char)**src))
-		(*src)++;
-	return **src ? *((*src)++) : '=';  /* emulate padding if string ends */
+	int a = b64->d[0], b = b64->d[1], c = b64->d[2], d = b64->d[3];
+
+	b64->n = 0;
+	/* invalid input. 'a' can be -1, e.g. if src is "\n" (c-str) */
+	if (a == -1 || b == -1) {
+		b64->end = 1;
+		return 0;
+	}
+	dst[0] = (a << 2) | ((b & 0x30) >> 4);
+	if (c == -1) {
+		b64->end = 1;
+		return 1;
+	}
+	dst[1] = ((b & 0x0f) << 4) | ((c & 0x3c) >> 2);
+	if (d == -1) {
+		b64->end = 1;
+		return 2;
+	}
+	dst[2] = ((c & 0x03) << 6) | d;
+	return 3;
 }
 
-char *
-base64dec(const char *src)
+/*
+ * Decode n bytes of base64 from src to dst and return the number of bytes
+ * written. Digits of an incomplete quantum are kept in b64 for the next
+ * call, so dst must have room for n / 4 * 3 + 3 bytes.
+ */
+size_t
+base64dec(char *dst, const char *src, size_t n, Base64 *b64)
 {
-	size_t in_len = strlen(src);
-	char *result, *dst;
 	static const char base64_digits[256] = {
 		[43] = 62, 0, 0, 0, 63, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61,
 		0, 0, 0, -1, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
@@ -378,29 +490,27 @@ base64dec(const char *src)
 		40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51
 	};
 
-	if (in_len % 4)
-		in_len += 4 - (in_len % 4);
-	result = dst = xmalloc(in_len / 4 * 3 + 1);
-	while (*src) {
-		int a = base64_digits[(unsigned char) base64dec_getc(&src)];
-		int b = base64_digits[(unsigned char) base64dec_getc(&src)];
-		int c = base64_digits[(unsigned char) base64dec_getc(&src)];
-		int d = base64_digits[(unsigned char) base64dec_getc(&src)];
-
-		/* invalid input. 'a' can be -1, e.g. if src is "\n" (c-str) */
-		if (a == -1 || b == -1)
-			break;
+	char *p = dst;
 
-		*dst++ = (a << 2) | ((b & 0x30) >> 4);
-		if (c == -1)
-			break;
-		*dst++ = ((b & 0x0f) << 4) | ((c & 0x3c) >> 2);
-		if (d == -1)
-			break;
-		*dst++ = ((c & 0x03) << 6) | d;
+	for (; n > 0 && !b64->end; n--, src++) {
+		if (!isprint((unsigned char)*src))
+			continue;
+		b64->d[b64->n++] = base64_digits[(unsigned char)*src];
+		if (b64->n == 4)
+			p += base64quantum(p, b64);
 	}
-	*dst = '\0';
-	return result;
+	return p - dst;
+}
+
+/* decode the digits left when the input ends, as if it was padded */
+size_t
+base64end(char *dst, Base64 *b64)
+{
+	if (b64->n == 0 || b64->end)
+		return 0;
+	while (b64->n < 4)
+		b64->d[b64->n++] = -1;
+	return base64quantum(dst, b64);
 }
 
 void
@@ -414,15 +524,17 @@ selinit(void)
 int
 tlinelen(int y)
 {
-	int i = term.col;
+	Line line = TLINE(y);
+	int i;
 
-	if (TLINE(y)[i - 1].mode & ATTR_WRAP)
-		return i;
+	if (line[term.col - 1].mode & ATTR_WRAP)
+		return term.col;
 
-	while (i > 0 && TLINE(y)[i - 1].u == ' ')
-		--i;
+	/* only the cells below the used length can be non-blank */
+	for (i = LINEUSED(line); i > 0 && line[i - 1].u == ' '; --i)
+		;
 
-	return i;
+	return LINEUSED(line) = i;
 }
 
 void
@@ -732,6 +844,9 @@ sigchld(int a)
 		die("child exited with status %d\n", WEXITSTATUS(stat));
 	else if (WIFSIGNALED(stat))
 		die("child terminated due to signal %d\n", WTERMSIG(stat));
+	recflush();
+	/* _exit() skips the atexit() handlers */
+	xexit();
 	_exit(0);
 }
 
@@ -837,6 +952,8 @@ ttyread(void)
 	case -1:
 		die("couldn't read from shell: %s\n", strerror(errno));
 	default:
+		if (recfd >= 0)
+			recchunk(buf + buflen, ret);
 		buflen += ret;
 		written = twrite(buf, buflen, 0);
 		buflen -= written;
@@ -946,6 +1063,317 @@ ttyresize(int tw, int th)
 	w.ws_ypixel = th;
 	if (ioctl(cmdfd, TIOCSWINSZ, &w) < 0)
 		fprintf(stderr, "Couldn't set window size: %s\n", strerror(errno));
+
+	recw = tw;
+	rech = th;
+	if (recfd >= 0)
+		recsize();
+}
+
+/*
+ * The transcript is a sequence of records, each starting with a text
+ * header line giving the type and the time since recording started:
+ *
+ *	d <sec>.<nsec> <len>\n		followed by <len> bytes read from the tty
+ *	r <sec>.<nsec> <col> <row> <xpixel> <ypixel>\n
+ *
+ * Every recording starts with an r record at time 0, see st-replay.c.
+ */
+void
+recflush(void)
+{
+	if (reclen && xwrite(recfd, recbuf, reclen) < 0)
+		fprintf(stderr, "recording: write: %s\n", strerror(errno));
+	reclen = 0;
+}
+
+void
+recwrite(const char *s, size_t n)
+{
+	if (reclen + n > sizeof(recbuf))
+		recflush();
+	if (n >= sizeof(recbuf)) {
+		if (xwrite(recfd, s, n) < 0)
+			fprintf(stderr, "recording: write: %s\n", strerror(errno));
+		return;
+	}
+	memcpy(recbuf + reclen, s, n);
+	reclen += n;
+}
+
+int
+recheader(char *buf, size_t siz, int type)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now.tv_sec -= recstart.tv_sec;
+	if ((now.tv_nsec -= recstart.tv_nsec) < 0) {
+		now.tv_sec--;
+		now.tv_nsec += 1000000000;
+	}
+	return snprintf(buf, siz, "%c %lld.%09ld", type,
+			(long long)now.tv_sec, now.tv_nsec);
+}
+
+void
+recchunk(const char *s, size_t n)
+{
+	char hdr[64];
+	int len;
+
+	len = recheader(hdr, sizeof(hdr), 'd');
+	len += snprintf(hdr + len, sizeof(hdr) - len, " %zu\n", n);
+	recwrite(hdr, len);
+	recwrite(s, n);
+}
+
+void
+recsize(void)
+{
+	char hdr[96];
+	int len;
+
+	len = recheader(hdr, sizeof(hdr), 'r');
+	len += snprintf(hdr + len, sizeof(hdr) - len, " %d %d %d %d\n",
+			term.col, term.row, recw, rech);
+	recwrite(hdr, len);
+}
+
+void
+ttyrecord(const char *path)
+{
+	if (recfd >= 0) {
+		recflush();
+		close(recfd);
+	}
+	/* never follow a link planted where the transcript goes */
+	if ((recfd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_NOFOLLOW,
+	                  0600)) < 0) {
+		fprintf(stderr, "recording: open %s: %s\n", path, strerror(errno));
+		return;
+	}
+	if (!recpath) {
+		recpath = xstrdup(path);
+		atexit(recflush);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &recstart);
+	recsize();
+}
+
+void
+togglerecord(const Arg *arg)
+{
+	char path[PATH_MAX];
+	const char *dir;
+
+	if (recfd < 0) {
+		if (recpath || arg->s[0] == '/') {
+			ttyrecord(recpath ? recpath : arg->s);
+			return;
+		}
+		/* relative names are kept out of the shared /tmp */
+		if (!(dir = getenv("XDG_RUNTIME_DIR")) && !(dir = getenv("HOME"))) {
+			fprintf(stderr, "recording: no XDG_RUNTIME_DIR or HOME\n");
+			return;
+		}
+		if (snprintf(path, sizeof(path), "%s/%s", dir, arg->s) >= sizeof(path)) {
+			fprintf(stderr, "recording: path too long\n");
+			return;
+		}
+		ttyrecord(path);
+		return;
+	}
+	recflush();
+	close(recfd);
+	recfd = -1;
+}
+
+int
+tlinkid(const char *uri)
+{
+	int i;
+
+	if (strlen(uri) > URI_MAX)
+		return 0;
+	/* links usually repeat on consecutive lines */
+	for (i = linki; i > 0 && i > linki - 16; i--) {
+		if (links[i] && !strcmp(links[i], uri))
+			return i;
+	}
+
+	linki = tlinkslot();
+	links[linki] = xstrdup(uri);
+
+	return linki;
+}
+
+/*
+ * Find an unused id: the table grows up to all ids, after that the targets
+ * no cell refers to any more are collected. Only when every id is still
+ * shown somewhere the next one is taken away from its cells.
+ */
+int
+tlinkslot(void)
+{
+	int i, n, old, gc = 0;
+
+	for (;;) {
+		for (n = 1; n < linksiz; n++) {
+			i = (linki + n - 1) % (linksiz - 1) + 1;
+			if (!links[i])
+				return i;
+		}
+		if (linksiz <= USHRT_MAX) {
+			old = linksiz;
+			linksiz = MIN(MAX(linksiz * 2, 64), USHRT_MAX + 1);
+			links = xrealloc(links, linksiz * sizeof(*links));
+			memset(links + old, 0, (linksiz - old) * sizeof(*links));
+		} else if (!gc) {
+			linkused = xmalloc(linksiz);
+			memset(linkused, 0, linksiz);
+			tlinkwalk(tlinkmark);
+			for (i = 1; i < linksiz; i++) {
+				if (!linkused[i]) {
+					free(links[i]);
+					links[i] = NULL;
+				}
+			}
+			free(linkused);
+			linkused = NULL;
+			gc = 1;
+		} else {
+			linkdrop = linki % USHRT_MAX + 1;
+			tlinkwalk(tlinkunref);
+			free(links[linkdrop]);
+			links[linkdrop] = NULL;
+			return linkdrop;
+		}
+	}
+}
+
+/* call fn on the link id of every cell and cursor that can hold one */
+void
+tlinkwalk(void (*fn)(ushort *))
+{
+	PackedRun run;
+	Rune u;
+	char *p;
+	int i, x;
+
+	for (i = 0; i < term.row; i++) {
+		for (x = 0; x < term.col; x++) {
+			fn(&term.line[i][x].link);
+			if (term.alt[i])
+				fn(&term.alt[i][x].link);
+		}
+	}
+	for (i = 0; i < HISTSIZE; i++) {
+		for (x = 0; term.hist[i] && x < term.col; x++)
+			fn(&term.hist[i][x].link);
+		for (p = term.phist[i]; p; ) {
+			memcpy(&run, p, sizeof(run));
+			if (run.n == 0)
+				break;
+			fn(&run.link);
+			memcpy(p, &run, sizeof(run));
+			p += sizeof(run);
+			for (x = 0; x < run.n; x++)
+				p += utf8decode(p, &u, UTF_SIZ);
+		}
+	}
+	fn(&term.c.attr.link);
+	fn(&term.sc[0].attr.link);
+	fn(&term.sc[1].attr.link);
+}
+
+void
+tlinkmark(ushort *id)
+{
+	linkused[*id] = 1;
+}
+
+void
+tlinkunref(ushort *id)
+{
+	if (*id == linkdrop)
+		*id = 0;
+}
+
+int
+isurlchar(Rune u)
+{
+	return u > ' ' && u < 0x7f && !strchr("<>\"`{}|\\^", u);
+}
+
+/*
+ * Find the URLs written as plain text in visible line y: each of their
+ * cells holds the start column of the URL plus one, other cells 0. The
+ * result is kept until the line is drawn again or scrolled away, so
+ * lookups do not rescan the screen.
+ */
+ushort *
+turlline(int y)
+{
+	Line line = TLINE(y);
+	ushort *url = term.url[y];
+	int x, s, e;
+
+	if (term.urlok[y] && !term.dirty[y])
+		return url;
+
+	memset(url, 0, term.col * sizeof(*url));
+	for (x = 1; x + 3 < term.col; x++) {
+		if (line[x].u != ':' || line[x+1].u != '/' || line[x+2].u != '/')
+			continue;
+		/* scheme */
+		for (s = x; s > 0 && BETWEEN(line[s-1].u, 0x21, 0x7e) &&
+		     (isalnum(line[s-1].u) || strchr("+-.", line[s-1].u)); s--)
+			;
+		while (s < x && !isalpha(line[s].u))
+			s++;
+		for (e = x + 3; e < term.col && isurlchar(line[e].u); e++)
+			;
+		/* trailing punctuation most likely ends the sentence */
+		while (e > x + 3 && strchr(".,:;!?'\")]", line[e-1].u))
+			e--;
+		if (s == x || e == x + 3)
+			continue;
+		for (x = s; x < e; x++)
+			url[x] = s + 1;
+	}
+	term.urlok[y] = 1;
+
+	return url;
+}
+
+/* target of the OSC 8 hyperlink or plain text URL at x, y or NULL */
+const char *
+tlinkat(int x, int y)
+{
+	static char *buf;
+	Line line;
+	ushort *url;
+	int s, e;
+	char *p;
+
+	if (!BETWEEN(x, 0, term.col-1) || !BETWEEN(y, 0, term.row-1))
+		return NULL;
+	line = TLINE(y);
+	if (line[x].link)
+		return links[line[x].link];
+
+	url = turlline(y);
+	if (!url[x])
+		return NULL;
+	for (s = e = url[x] - 1; e < term.col && url[e] == url[x]; e++)
+		;
+	buf = xrealloc(buf, e - s + 1);
+	for (p = buf; s < e; s++)
+		*p++ = line[s].u;
+	*p = '\0';
+
+	return buf;
 }
 
 void
@@ -955,11 +1383,35 @@ ttyhangup(void)
 	kill(pid, SIGHUP);
 }
 
+int
+tblinkcount(const Glyph *line)
+{
+	int x, n = 0;
+
+	for (x = 0; x < term.col; x++)
+		n += (line[x].mode & ATTR_BLINK) != 0;
+
+	return n;
+}
+
+/* recount the blinking cells of a line after it was moved around in bulk */
+void
+tblinkline(int y)
+{
+	int n = tblinkcount(term.line[y]);
+
+	term.nblink += n - term.blink[y];
+	term.blink[y] = n;
+}
+
 int
 tattrset(int attr)
 {
 	int i, j;
 
+	if (attr == ATTR_BLINK)
+		return term.nblink > 0;
+
 	for (i = 0; i < term.row-1; i++) {
 		for (j = 0; j < term.col-1; j++) {
 			if (term.line[i][j].mode & attr)
@@ -987,6 +1439,14 @@ tsetdirtattr(int attr)
 {
 	int i, j;
 
+	if (attr == ATTR_BLINK) {
+		for (i = 0; i < term.row; i++) {
+			if (term.blink[i])
+				tsetdirt(i, i);
+		}
+		return;
+	}
+
 	for (i = 0; i < term.row-1; i++) {
 		for (j = 0; j < term.col-1; j++) {
 			if (term.line[i][j].mode & attr) {
@@ -997,16 +1457,47 @@ tsetdirtattr(int attr)
 	}
 }
 
+void
+tsync_begin(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &sutv);
+	su = 1;
+}
+
+void
+tsync_end(void)
+{
+	su = 0;
+}
+
+/*
+ * Returns 1 while the application holds a synchronized update (mode 2026)
+ * open and drawing should be deferred. The update is forcibly ended after
+ * timeout ms, so a client which never sends the end sequence cannot freeze
+ * the screen.
+ */
+int
+tinsync(uint timeout)
+{
+	struct timespec now;
+
+	if (su && !clock_gettime(CLOCK_MONOTONIC, &now)
+	       && TIMEDIFF(now, sutv) >= timeout)
+		su = 0;
+	return su;
+}
+
 void
 tfulldirt(void)
 {
+	term.pscroll = 0;
 	tsetdirt(0, term.row-1);
 }
 
 void
 tcursor(int mode)
 {
-	static TCursor c[2];
+	TCursor *c = term.sc;
 	int alt = IS_SET(MODE_ALTSCREEN);
 
 	if (mode == CURSOR_SAVE) {
@@ -1035,6 +1526,7 @@ treset(void)
 	term.bot = term.row - 1;
 	term.mode = MODE_WRAP|MODE_UTF8;
 	memset(term.trantbl, CS_USA, sizeof(term.trantbl));
+	tsync_end();
 	term.charset = 0;
 
 	for (i = 0; i < 2; i++) {
@@ -1061,10 +1553,20 @@ int tisaltscr(void)
 void
 tswapscreen(void)
 {
-	Line *tmp = term.line;
+	Line *tmp;
+	int *blink, nblink;
+
+	texpand();
+	tmp = term.line;
+	blink = term.blink;
+	nblink = term.nblink;
 
 	term.line = term.alt;
 	term.alt = tmp;
+	term.blink = term.altblink;
+	term.altblink = blink;
+	term.nblink = term.altnblink;
+	term.altnblink = nblink;
 	term.mode ^= MODE_ALTSCREEN;
 	tfulldirt();
 }
@@ -1095,6 +1597,7 @@ kscrollup(const Arg* a)
 	if (n < 0)
 		n = term.row + n;
 
+	texpand();
 	if (term.scr <= HISTSIZE-n) {
 		term.scr += n;
 		selscroll(0, n);
@@ -1102,11 +1605,26 @@ kscrollup(const Arg* a)
 	}
 }
 
+/*
+ * The whole visible screen moved up by n lines (down if n < 0). The dirty
+ * flags already moved along with the lines, so only the lines uncovered by
+ * the scroll are dirty; the rest is moved by the backend with one copy of
+ * the drawn pixels in draw().
+ */
+void
+tscrollpixels(int n)
+{
+	term.pscroll += n;
+	if (abs(term.pscroll) >= term.row)
+		tfulldirt();
+}
+
 void
 tscrolldown(int orig, int n, int copyhist)
 {
-	int i;
+	int i, dirt;
 	Line temp;
+	ushort *url;
 
 	LIMIT(n, 0, term.bot-orig+1);
 
@@ -1117,14 +1635,30 @@ tscrolldown(int orig, int n, int copyhist)
 		term.line[term.bot] = temp;
 	}
 
-	tsetdirt(orig, term.bot-n);
 	tclearregion(0, term.bot-n+1, term.col-1, term.bot);
 
 	for (i = term.bot; i >= orig+n; i--) {
 		temp = term.line[i];
 		term.line[i] = term.line[i-n];
 		term.line[i-n] = temp;
-	}
+		dirt = term.dirty[i];
+		term.dirty[i] = term.dirty[i-n];
+		term.dirty[i-n] = dirt;
+		dirt = term.blink[i];
+		term.blink[i] = term.blink[i-n];
+		term.blink[i-n] = dirt;
+		dirt = term.urlok[i];
+		term.urlok[i] = term.urlok[i-n];
+		term.urlok[i-n] = dirt;
+		url = term.url[i];
+		term.url[i] = term.url[i-n];
+		term.url[i-n] = url;
+	}
+
+	if (orig == 0 && term.bot == term.row-1 && term.scr == 0)
+		tscrollpixels(-n);
+	else
+		tsetdirt(orig, term.bot);
 
 	if (term.scr == 0)
 		selscroll(orig, n);
@@ -1133,8 +1667,9 @@ tscrolldown(int orig, int n, int copyhist)
 void
 tscrollup(int orig, int n, int copyhist)
 {
-	int i;
+	int i, dirt;
 	Line temp;
+	ushort *url;
 
 	LIMIT(n, 0, term.bot-orig+1);
 
@@ -1149,13 +1684,29 @@ tscrollup(int orig, int n, int copyhist)
 		term.scr = MIN(term.scr + n, HISTSIZE-1);
 
 	tclearregion(0, orig, term.col-1, orig+n-1);
-	tsetdirt(orig+n, term.bot);
 
 	for (i = orig; i <= term.bot-n; i++) {
 		temp = term.line[i];
 		term.line[i] = term.line[i+n];
 		term.line[i+n] = temp;
-	}
+		dirt = term.dirty[i];
+		term.dirty[i] = term.dirty[i+n];
+		term.dirty[i+n] = dirt;
+		dirt = term.blink[i];
+		term.blink[i] = term.blink[i+n];
+		term.blink[i+n] = dirt;
+		dirt = term.urlok[i];
+		term.urlok[i] = term.urlok[i+n];
+		term.urlok[i+n] = dirt;
+		url = term.url[i];
+		term.url[i] = term.url[i+n];
+		term.url[i+n] = url;
+	}
+
+	if (orig == 0 && term.bot == term.row-1 && term.scr == 0)
+		tscrollpixels(n);
+	else
+		tsetdirt(orig, term.bot);
 
 	if (term.scr == 0)
 		selscroll(orig, -n);
@@ -1251,6 +1802,7 @@ tmoveto(int x, int y)
 void
 tsetchar(Rune u, const Glyph *attr, int x, int y)
 {
+	int n;
 	static const char *vt100_0[62] = { /* 0x41 - 0x7e */
 		"↑", "↓", "→", "←", "█", "▚", "☃", /* A - G */
 		0, 0, 0, 0, 0, 0, 0, 0, /* H - O */
@@ -1279,9 +1831,17 @@ tsetchar(Rune u, const Glyph *attr, int x, int y)
 		term.line[y][x-1].mode &= ~ATTR_WIDE;
 	}
 
+	if ((term.line[y][x].mode ^ attr->mode) & ATTR_BLINK) {
+		n = (attr->mode & ATTR_BLINK) ? 1 : -1;
+		term.blink[y] += n;
+		term.nblink += n;
+	}
+
 	term.dirty[y] = 1;
 	term.line[y][x] = *attr;
 	term.line[y][x].u = u;
+	if (u != ' ' && LINEUSED(term.line[y]) <= x)
+		LINEUSED(term.line[y]) = x + 1;
 }
 
 void
@@ -1309,8 +1869,17 @@ tclearregion(int x1, int y1, int x2, int y2)
 			gp->fg = term.c.attr.fg;
 			gp->bg = term.c.attr.bg;
 			gp->mode = 0;
+			gp->link = 0;
 			gp->u = ' ';
 		}
+		if (x2 + 1 >= LINEUSED(term.line[y]))
+			LINEUSED(term.line[y]) = MIN(LINEUSED(term.line[y]), x1);
+		if (x1 == 0 && x2 == term.col-1) {
+			term.nblink -= term.blink[y];
+			term.blink[y] = 0;
+		} else if (term.blink[y]) {
+			tblinkline(y);
+		}
 	}
 }
 
@@ -1345,6 +1914,7 @@ tinsertblank(int n)
 	line = term.line[term.c.y];
 
 	memmove(&line[dst], &line[src], size * sizeof(Glyph));
+	LINEUSED(line) = MIN(LINEUSED(line) + n, term.col);
 	tclearregion(src, term.c.y, dst - 1, term.c.y);
 }
 
@@ -1618,6 +2188,12 @@ tsetmode(int priv, int set, const int *args, int narg)
 			case 2004: /* 2004: bracketed paste mode */
 				xsetmode(set, MODE_BRCKTPASTE);
 				break;
+			case 2026: /* 2026: synchronized update */
+				if (set)
+					tsync_begin();
+				else
+					tsync_end();
+				break;
 			/* Not implemented mouse modes. See comments there. */
 			case 1001: /* mouse highlight mode; can hang the
 				      terminal by design when implemented. */
@@ -1866,6 +2442,20 @@ csihandle(void)
 	case 'u': /* DECRC -- Restore cursor position (ANSI.SYS) */
 		tcursor(CURSOR_LOAD);
 		break;
+	case '$':
+		switch (csiescseq.mode[1]) {
+		case 'p': /* DECRQM -- Request Mode */
+			/* only synchronized update is reported, see tsetmode */
+			if (!csiescseq.priv || csiescseq.arg[0] != 2026)
+				goto unknown;
+			len = snprintf(buf, sizeof(buf), "\033[?2026;%d$y",
+			               su ? 1 : 2);
+			ttywrite(buf, len, 0);
+			break;
+		default:
+			goto unknown;
+		}
+		break;
 	case ' ':
 		switch (csiescseq.mode[1]) {
 		case 'q': /* DECSCUSR -- Set Cursor Style */
@@ -1939,6 +2529,7 @@ strhandle(void)
 {
 	char *p = NULL, *dec;
 	int j, narg, par;
+	size_t n;
 	const struct { int idx; char *str; } osc_table[] = {
 		{ defaultfg, "foreground" },
 		{ defaultbg, "background" },
@@ -1946,6 +2537,11 @@ strhandle(void)
 	};
 
 	term.esc &= ~(ESC_STR_END|ESC_STR);
+	if (strescseq.drop) {
+		fprintf(stderr, "erresc: string sequence longer than %u bytes\n",
+		        maxstrlen);
+		return;
+	}
 	strparse();
 	par = (narg = strescseq.narg) ? atoi(strescseq.args[0]) : 0;
 
@@ -1966,15 +2562,29 @@ strhandle(void)
 			if (narg > 1)
 				xsettitle(strescseq.args[1]);
 			return;
+		case 8: /* ESC ] 8 ; params ; URI ST */
+			if (narg < 3) {
+				term.c.attr.link = 0;
+				return;
+			}
+			/* the URI itself may contain ';' */
+			for (p = strescseq.args[2]; p < strescseq.buf + strescseq.len; p++) {
+				if (!*p)
+					*p = ';';
+			}
+			term.c.attr.link = *strescseq.args[2] ?
+				tlinkid(strescseq.args[2]) : 0;
+			return;
 		case 52:
-			if (narg > 2 && allowwindowops) {
-				dec = base64dec(strescseq.args[2]);
-				if (dec) {
-					xsetsel(dec);
-					xclipcopy();
-				} else {
-					fprintf(stderr, "erresc: invalid base64\n");
-				}
+			if (strescseq.b64 && allowwindowops) {
+				n = strescseq.len - strescseq.b64;
+				n += base64end(&strescseq.buf[strescseq.len],
+				               &strescseq.dec);
+				dec = xmalloc(n + 1);
+				memcpy(dec, &strescseq.buf[strescseq.b64], n);
+				dec[n] = '\0';
+				xsetsel(dec);
+				xclipcopy();
 			}
 			return;
 		case 10:
@@ -2043,6 +2653,9 @@ strparse(void)
 
 	strescseq.narg = 0;
 	strescseq.buf[strescseq.len] = '\0';
+	/* keep the decoded OSC 52 data out of the arguments */
+	if (strescseq.b64)
+		strescseq.buf[strescseq.b64 - 1] = '\0';
 
 	if (*p == '\0')
 		return;
@@ -2163,6 +2776,214 @@ tdump(void)
 		tdumpline(i);
 }
 
+size_t
+texportsgr(char *buf, const Glyph *g)
+{
+	static const struct { ushort attr; char *sgr; } attrs[] = {
+		{ ATTR_BOLD,      ";1" },
+		{ ATTR_FAINT,     ";2" },
+		{ ATTR_ITALIC,    ";3" },
+		{ ATTR_UNDERLINE, ";4" },
+		{ ATTR_BLINK,     ";5" },
+		{ ATTR_REVERSE,   ";7" },
+		{ ATTR_INVISIBLE, ";8" },
+		{ ATTR_STRUCK,    ";9" },
+	};
+	uint32_t col[] = { g->fg, g->bg }, defcol[] = { defaultfg, defaultbg };
+	char *p = buf;
+	int i;
+
+	p += sprintf(p, "\033[0");
+	for (i = 0; i < LEN(attrs); i++) {
+		if (g->mode & attrs[i].attr)
+			p += sprintf(p, "%s", attrs[i].sgr);
+	}
+	for (i = 0; i < 2; i++) {
+		if (col[i] == defcol[i])
+			continue;
+		if (IS_TRUECOL(col[i])) {
+			p += sprintf(p, ";%d8;2;%d;%d;%d", 3 + i,
+			             (col[i] >> 16) & 0xff, (col[i] >> 8) & 0xff,
+			             col[i] & 0xff);
+		} else if (col[i] < 8) {
+			p += sprintf(p, ";%d", 30 + 10 * i + col[i]);
+		} else if (col[i] < 16) {
+			p += sprintf(p, ";%d", 90 + 10 * i + col[i] - 8);
+		} else {
+			p += sprintf(p, ";%d8;5;%d", 3 + i, col[i]);
+		}
+	}
+	*p++ = 'm';
+
+	return p - buf;
+}
+
+void *
+texportchunk(void *arg)
+{
+	/* longest SGR sequence written by texportsgr() */
+	enum { SGR_SIZ = 64 };
+	ExportChunk *c = arg;
+	Glyph blank = { .u = ' ', .fg = defaultfg, .bg = defaultbg };
+	const Glyph *gp, *end, *prev;
+	size_t need;
+	int i, wrap;
+
+	for (i = 0; i < c->n; i++) {
+		gp = c->lines[i];
+		end = &gp[term.col];
+		if (!(wrap = end[-1].mode & ATTR_WRAP)) {
+			if (!c->sgr)
+				end = &gp[LINEUSED(gp)];
+			while (end > gp && end[-1].u == ' ' &&
+			       (!c->sgr || !ATTRCMP(end[-1], blank)))
+				end--;
+		}
+
+		need = (end - gp) * (UTF_SIZ + (c->sgr ? SGR_SIZ : 0)) +
+		       SGR_SIZ + 1;
+		if (c->len + need > c->siz) {
+			c->siz = MAX(c->siz * 2, c->len + need);
+			c->buf = xrealloc(c->buf, c->siz);
+		}
+
+		for (prev = &blank; gp < end; gp++) {
+			if (gp->mode & ATTR_WDUMMY)
+				continue;
+			if (c->sgr && ATTRCMP(*gp, *prev)) {
+				c->len += texportsgr(&c->buf[c->len], gp);
+				prev = gp;
+			}
+			c->len += utf8encode(gp->u, &c->buf[c->len]);
+		}
+		if (ATTRCMP(*prev, blank)) {
+			memcpy(&c->buf[c->len], "\033[0m", 4);
+			c->len += 4;
+		}
+		if (!wrap)
+			c->buf[c->len++] = '\n';
+	}
+
+	return NULL;
+}
+
+/*
+ * Write the whole scrollback and the main screen to the output of the -o
+ * option, or to the standard input of the shell command cmd. With sgr
+ * attributes are kept as SGR sequences. A large history is encoded in
+ * chunks by several threads, each chunk is written with a single write().
+ */
+void
+texport(const char *cmd, int sgr)
+{
+	/* lines per encoding thread */
+	enum { EXPORTCHUNK = 512 };
+	ExportChunk *chunks;
+	Glyph blank = { .u = ' ', .fg = defaultfg, .bg = defaultbg };
+	Line *lines, *screen;
+	void (*sigpipe)(int);
+	int i, j, n, nchunk, fd, fds[2];
+	pid_t child;
+
+	if (cmd) {
+		if (pipe(fds) < 0) {
+			perror("Couldn't create export pipe");
+			return;
+		}
+		/* fork twice, so the command is not left as a zombie */
+		switch (child = fork()) {
+		case -1:
+			perror("Couldn't fork export command");
+			close(fds[0]);
+			close(fds[1]);
+			return;
+		case 0:
+			if (fork() == 0) {
+				close(cmdfd);
+				dup2(fds[0], 0);
+				close(fds[0]);
+				close(fds[1]);
+				execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+				_exit(127);
+			}
+			_exit(0);
+		}
+		close(fds[0]);
+		waitpid(child, NULL, 0);
+		fd = fds[1];
+	} else if ((fd = iofd) == -1) {
+		return;
+	}
+
+	texpand();
+	n = HISTSIZE + term.row;
+	lines = xmalloc(n * sizeof(*lines));
+	for (i = 0; i < HISTSIZE; i++)
+		lines[i] = term.hist[(term.histi + 1 + i) % HISTSIZE];
+	screen = IS_SET(MODE_ALTSCREEN) ? term.alt : term.line;
+	for (i = 0; i < term.row; i++)
+		lines[HISTSIZE + i] = screen[i];
+
+	/* skip the part of the history never written to */
+	for (i = 0; i < HISTSIZE; i++) {
+		for (j = 0; j < term.col && !ATTRCMP(lines[i][j], blank) &&
+		     lines[i][j].u == ' '; j++)
+			;
+		if (j < term.col)
+			break;
+	}
+	n -= i;
+
+	nchunk = MIN(MAX(n / EXPORTCHUNK, 1), MAX(sysconf(_SC_NPROCESSORS_ONLN), 1));
+	chunks = xmalloc(nchunk * sizeof(*chunks));
+	for (j = 0; j < nchunk; j++) {
+		chunks[j] = (ExportChunk){
+			.lines = &lines[i + n / nchunk * j],
+			.n = (j == nchunk - 1) ? n - n / nchunk * j : n / nchunk,
+			.sgr = sgr,
+		};
+	}
+	for (j = 1; j < nchunk; j++) {
+		chunks[j].threaded = !pthread_create(&chunks[j].thread, NULL,
+		                                     texportchunk, &chunks[j]);
+		if (!chunks[j].threaded)
+			texportchunk(&chunks[j]);
+	}
+	texportchunk(&chunks[0]);
+
+	sigpipe = signal(SIGPIPE, SIG_IGN);
+	for (j = 0; j < nchunk; j++) {
+		if (chunks[j].threaded)
+			pthread_join(chunks[j].thread, NULL);
+		if (fd != -1 && xwrite(fd, chunks[j].buf, chunks[j].len) < 0) {
+			perror("Error writing scrollback");
+			if (fd == iofd)
+				iofd = -1;
+			close(fd);
+			fd = -1;
+		}
+		free(chunks[j].buf);
+	}
+	signal(SIGPIPE, sigpipe);
+	if (cmd && fd != -1)
+		close(fd);
+
+	free(chunks);
+	free(lines);
+}
+
+void
+exporthist(const Arg *arg)
+{
+	texport(arg->s, 0);
+}
+
+void
+exporthistsgr(const Arg *arg)
+{
+	texport(arg->s, 1);
+}
+
 void
 tputtab(int n)
 {
@@ -2261,6 +3082,7 @@ tcontrolcode(uchar ascii)
 		if (term.esc & ESC_STR_END) {
 			/* backwards compatibility to xterm */
 			strhandle();
+			strreset();
 		} else {
 			xbell();
 		}
@@ -2411,8 +3233,10 @@ eschandle(uchar ascii)
 		tcursor(CURSOR_LOAD);
 		break;
 	case '\\': /* ST -- String Terminator */
-		if (term.esc & ESC_STR_END)
+		if (term.esc & ESC_STR_END) {
 			strhandle();
+			strreset();
+		}
 		break;
 	default:
 		fprintf(stderr, "erresc: unknown sequence ESC 0x%02X '%c'\n",
@@ -2457,28 +3281,39 @@ tputc(Rune u)
 			goto check_control_code;
 		}
 
-		if (strescseq.len+len >= strescseq.siz) {
-			/*
-			 * Here is a bug in terminals. If the user never sends
-			 * some code to stop the str or esc command, then st
-			 * will stop responding. But this is better than
-			 * silently failing with unknown characters. At least
-			 * then users will report back.
-			 *
-			 * In the case users ever get fixed, here is the code:
-			 */
+		if (strescseq.drop)
+			return;
+
+		if (strescseq.len + UTF_SIZ >= strescseq.siz) {
 			/*
-			 * term.esc = 0;
-			 * strhandle();
+			 * A string which is never terminated would grow
+			 * without bound. Past maxstrlen the rest of it is
+			 * ignored up to its terminator.
 			 */
-			if (strescseq.siz > (SIZE_MAX - UTF_SIZ) / 2)
+			if (strescseq.siz > maxstrlen / 2) {
+				strescseq.drop = 1;
 				return;
+			}
 			strescseq.siz *= 2;
 			strescseq.buf = xrealloc(strescseq.buf, strescseq.siz);
 		}
 
+		if (strescseq.b64) {
+			if (allowwindowops) {
+				strescseq.len += base64dec(&strescseq.buf[strescseq.len],
+				                           c, len, &strescseq.dec);
+			}
+			return;
+		}
+
 		memmove(&strescseq.buf[strescseq.len], c, len);
 		strescseq.len += len;
+
+		/* "52;<selection>;" is complete, decode the rest as it comes */
+		if (u == ';' && strescseq.type == ']' && strescseq.len > 3 &&
+		    !memcmp(strescseq.buf, "52;", 3) &&
+		    !memchr(&strescseq.buf[3], ';', strescseq.len - 4))
+			strescseq.b64 = strescseq.len;
 		return;
 	}
 
@@ -2540,7 +3375,11 @@ check_control_code:
 
 	if (IS_SET(MODE_INSERT) && term.c.x+width < term.col) {
 		memmove(gp+width, gp, (term.col - term.c.x - width) * sizeof(Glyph));
+		LINEUSED(term.line[term.c.y]) =
+			MIN(LINEUSED(term.line[term.c.y]) + width, term.col);
 		gp->mode &= ~ATTR_WIDE;
+		if (term.blink[term.c.y])
+			tblinkline(term.c.y);
 	}
 
 	if (term.c.x+width > term.col) {
@@ -2558,8 +3397,14 @@ check_control_code:
 				gp[2].u = ' ';
 				gp[2].mode &= ~ATTR_WDUMMY;
 			}
+			if (gp[1].mode & ATTR_BLINK) {
+				term.blink[term.c.y]--;
+				term.nblink--;
+			}
 			gp[1].u = '\0';
 			gp[1].mode = ATTR_WDUMMY;
+			LINEUSED(term.line[term.c.y]) =
+				MAX(LINEUSED(term.line[term.c.y]), term.c.x + 2);
 		}
 	}
 	if (term.c.x+width < term.col) {
@@ -2576,6 +3421,8 @@ twrite(const char *buf, int buflen, int show_ctrl)
 	Rune u;
 	int n;
 
+	texpand();
+
 	for (n = 0; n < buflen; n += charsize) {
 		if (IS_SET(MODE_UTF8)) {
 			/* process a complete utf8 char */
@@ -2608,6 +3455,7 @@ tresize(int col, int row)
 	int minrow = MIN(row, term.row);
 	int mincol = MIN(col, term.col);
 	int *bp;
+	Rune used;
 	TCursor c;
 
 	if (col < 1 || row < 1) {
@@ -2616,6 +3464,8 @@ tresize(int col, int row)
 		return;
 	}
 
+	texpand();
+
 	/*
 	 * slide screen to keep cursor where we expect it -
 	 * tscrollup would work here, but we can optimize to
@@ -2639,26 +3489,50 @@ tresize(int col, int row)
 	term.line = xrealloc(term.line, row * sizeof(Line));
 	term.alt  = xrealloc(term.alt,  row * sizeof(Line));
 	term.dirty = xrealloc(term.dirty, row * sizeof(*term.dirty));
+	term.blink = xrealloc(term.blink, row * sizeof(*term.blink));
+	term.altblink = xrealloc(term.altblink, row * sizeof(*term.altblink));
+	/* recounted below, once all cells are initialized */
+	memset(term.blink, 0, row * sizeof(*term.blink));
+	memset(term.altblink, 0, row * sizeof(*term.altblink));
+	term.nblink = term.altnblink = 0;
 	term.tabs = xrealloc(term.tabs, col * sizeof(*term.tabs));
 
+	for (i = 0; i < term.row; i++)
+		free(term.url[i]);
+	term.url = xrealloc(term.url, row * sizeof(*term.url));
+	term.urlok = xrealloc(term.urlok, row * sizeof(*term.urlok));
+	for (i = 0; i < row; i++) {
+		term.url[i] = xmalloc(col * sizeof(**term.url));
+		term.urlok[i] = 0;
+	}
+
 	for (i = 0; i < HISTSIZE; i++) {
-		term.hist[i] = xrealloc(term.hist[i], col * sizeof(Glyph));
+		used = term.hist[i] ? MIN(LINEUSED(term.hist[i]), col) : 0;
+		term.hist[i] = xrealloc(term.hist[i], (col + 1) * sizeof(Glyph));
 		for (j = mincol; j < col; j++) {
 			term.hist[i][j] = term.c.attr;
+			term.hist[i][j].link = 0;
 			term.hist[i][j].u = ' ';
 		}
+		term.hist[i][col].u = used;
 	}
 
 	/* resize each row to new width, zero-pad if needed */
 	for (i = 0; i < minrow; i++) {
-		term.line[i] = xrealloc(term.line[i], col * sizeof(Glyph));
-		term.alt[i]  = xrealloc(term.alt[i],  col * sizeof(Glyph));
+		used = MIN(LINEUSED(term.line[i]), col);
+		term.line[i] = xrealloc(term.line[i], (col + 1) * sizeof(Glyph));
+		term.line[i][col].u = used;
+		used = MIN(LINEUSED(term.alt[i]), col);
+		term.alt[i]  = xrealloc(term.alt[i],  (col + 1) * sizeof(Glyph));
+		term.alt[i][col].u = used;
 	}
 
 	/* allocate any new rows */
 	for (/* i = minrow */; i < row; i++) {
-		term.line[i] = xmalloc(col * sizeof(Glyph));
-		term.alt[i] = xmalloc(col * sizeof(Glyph));
+		term.line[i] = xmalloc((col + 1) * sizeof(Glyph));
+		term.line[i][col].u = 0;
+		term.alt[i] = xmalloc((col + 1) * sizeof(Glyph));
+		term.alt[i][col].u = 0;
 	}
 	if (col > term.col) {
 		bp = term.tabs + term.col;
@@ -2689,6 +3563,140 @@ tresize(int col, int row)
 		tcursor(CURSOR_LOAD);
 	}
 	term.c = c;
+
+	for (i = 0; i < row; i++) {
+		term.blink[i] = tblinkcount(term.line[i]);
+		term.nblink += term.blink[i];
+		term.altblink[i] = tblinkcount(term.alt[i]);
+		term.altnblink += term.altblink[i];
+	}
+}
+
+/*
+ * Pack a history line into runs of equally attributed glyphs followed by
+ * their UTF-8 text. Trailing blanks are dropped, a blank line packs to NULL.
+ */
+char *
+tpackline(const Glyph *line)
+{
+	static char *buf;
+	static size_t siz;
+	PackedRun run;
+	const Glyph *gp, *end;
+	char *p;
+
+	for (end = &line[term.col]; end > line; --end) {
+		gp = end - 1;
+		if (gp->u != ' ' || gp->mode || gp->link ||
+		    gp->fg != defaultfg || gp->bg != defaultbg)
+			break;
+	}
+	if (end == line)
+		return NULL;
+
+	if (siz < (term.col + 1) * (sizeof(run) + UTF_SIZ)) {
+		siz = (term.col + 1) * (sizeof(run) + UTF_SIZ);
+		buf = xrealloc(buf, siz);
+	}
+
+	for (p = buf, gp = line; gp < end; ) {
+		run = (PackedRun){ .mode = gp->mode, .link = gp->link,
+		                   .fg = gp->fg, .bg = gp->bg };
+		for (line = gp; gp < end && !ATTRCMP(*gp, *line) &&
+		     gp->link == line->link; ++gp)
+			run.n++;
+		memcpy(p, &run, sizeof(run));
+		p += sizeof(run);
+		for (; line < gp; ++line)
+			p += utf8encode(line->u, p);
+	}
+	memset(p, 0, sizeof(run));
+	p += sizeof(run);
+
+	return memcpy(xmalloc(p - buf), buf, p - buf);
+}
+
+Line
+tunpackline(const char *p)
+{
+	Line line = xmalloc((term.col + 1) * sizeof(Glyph));
+	PackedRun run;
+	int x = 0;
+
+	for (; p; ) {
+		memcpy(&run, p, sizeof(run));
+		p += sizeof(run);
+		if (run.n == 0)
+			break;
+		for (; run.n > 0; run.n--, x++) {
+			line[x] = (Glyph){ .mode = run.mode, .link = run.link,
+			                   .fg = run.fg, .bg = run.bg };
+			p += utf8decode(p, &line[x].u, UTF_SIZ);
+		}
+	}
+	LINEUSED(line) = x;
+	for (; x < term.col; x++)
+		line[x] = (Glyph){ .u = ' ', .fg = defaultfg, .bg = defaultbg };
+
+	return line;
+}
+
+/*
+ * Give memory of an idle terminal back: pack the history, free the
+ * alternate screen if it is not in use and return the freed arenas to the
+ * system. Everything is restored by texpand() on the next use.
+ */
+void
+tcompact(void)
+{
+	int i;
+
+	if (term.compact || term.scr > 0)
+		return;
+
+	for (i = 0; i < HISTSIZE; i++) {
+		term.phist[i] = tpackline(term.hist[i]);
+		free(term.hist[i]);
+		term.hist[i] = NULL;
+	}
+	if (!IS_SET(MODE_ALTSCREEN)) {
+		for (i = 0; i < term.row; i++) {
+			free(term.alt[i]);
+			term.alt[i] = NULL;
+		}
+	}
+	term.compact = 1;
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+}
+
+void
+texpand(void)
+{
+	int i, x;
+
+	if (!term.compact)
+		return;
+
+	for (i = 0; i < HISTSIZE; i++) {
+		term.hist[i] = tunpackline(term.phist[i]);
+		free(term.phist[i]);
+		term.phist[i] = NULL;
+	}
+	if (!term.alt[0]) {
+		memset(term.altblink, 0, term.row * sizeof(*term.altblink));
+		term.altnblink = 0;
+	}
+	for (i = 0; i < term.row && !term.alt[i]; i++) {
+		term.alt[i] = xmalloc((term.col + 1) * sizeof(Glyph));
+		for (x = 0; x < term.col; x++) {
+			term.alt[i][x] = (Glyph){ .u = ' ',
+				.fg = term.c.attr.fg, .bg = term.c.attr.bg };
+		}
+		LINEUSED(term.alt[i]) = 0;
+	}
+	term.compact = 0;
 }
 
 void
@@ -2707,6 +3715,7 @@ drawregion(int x1, int y1, int x2, int y2)
 			continue;
 
 		term.dirty[y] = 0;
+		term.urlok[y] = 0;
 		xdrawline(TLINE(y), x1, y, x2);
 	}
 }
@@ -2719,6 +3728,13 @@ draw(void)
 	if (!xstartdraw())
 		return;
 
+	/* move the pixels of scrolled lines instead of redrawing them */
+	if (term.pscroll) {
+		xscroll(term.pscroll);
+		term.ocy -= term.pscroll;
+		term.pscroll = 0;
+	}
+
 	/* adjust cursor position */
 	LIMIT(term.ocx, 0, term.col-1);
 	LIMIT(term.ocy, 0, term.row-1);
@@ -63,6 +63,7 @@ typedef uint_least32_t Rune;
 typedef struct {
 	Rune u;           /* character code */
 	ushort mode;      /* attribute flags */
+	ushort link;      /* OSC 8 hyperlink id, 0 if none */
 	uint32_t fg;      /* foreground  */
 	uint32_t bg;      /* background  */
 } Glyph;
@@ -85,15 +86,22 @@ void kscrolldown(const Arg *);
 void kscrollup(const Arg *);
 void printscreen(const Arg *);
 void printsel(const Arg *);
+void exporthist(const Arg *);
+void exporthistsgr(const Arg *);
 void sendbreak(const Arg *);
 void toggleprinter(const Arg *);
+void togglerecord(const Arg *);
 
 int tattrset(int);
+void tcompact(void);
+int tinsync(uint);
 int tisaltscr(void);
 void tnew(int, int);
 void tresize(int, int);
 void tsetdirtattr(int);
+const char *tlinkat(int, int);
 void ttyhangup(void);
+void ttyrecord(const char *);
 int ttynew(const char *, char *, const char *, char **);
 size_t ttyread(void);
 void ttyresize(int, int);
@@ -122,6 +130,7 @@ extern char *vtiden;
 extern wchar_t *worddelimiters;
 extern int allowaltscreen;
 extern int allowwindowops;
+extern unsigned int maxstrlen;
 extern char *termname;
 extern unsigned int tabspaces;
 extern unsigned int defaultfg;
@@ -5,6 +5,7 @@
 #include <locale.h>
 #include <signal.h>
 #include <sys/select.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <libgen.h>
@@ -14,11 +15,19 @@
 #include <X11/keysym.h>
 #include <X11/Xft/Xft.h>
 #include <X11/XKBlib.h>
+#ifdef XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
 
 char *argv0;
 #include "arg.h"
 #include "st.h"
 #include "win.h"
+#ifdef HARFBUZZ
+#include "hb.h"
+#endif
 
 /* types used in config.h */
 typedef struct {
@@ -60,6 +69,7 @@ static void zoom(const Arg *);
 static void zoomabs(const Arg *);
 static void zoomreset(const Arg *);
 static void ttysend(const Arg *);
+static void latreport(const Arg *);
 
 /* config.h for applying patches and the configuration. */
 #include "config.h"
@@ -95,6 +105,9 @@ typedef struct {
 	Window win;
 	Drawable buf;
 	GlyphFontSpec *specbuf; /* font spec buffer used for rendering */
+#ifdef HARFBUZZ
+	Rune *specrunes; /* rune of each spec, for shaping */
+#endif
 	Atom xembed, wmdeletewin, netwmname, netwmiconname, netwmpid;
 	struct {
 		XIM xim;
@@ -109,11 +122,43 @@ typedef struct {
 	int isfixed; /* is fixed geometry? */
 	int l, t; /* left and top offset */
 	int gm; /* geometry mask */
+	int dy1, dy2; /* rows of buf damaged since the last xfinishdraw */
+#ifdef XSHM
+	int useshm; /* buf is a MIT-SHM pixmap */
+	XImage *shmimg; /* describes the pixel layout of the shared buf */
+	XShmSegmentInfo shminfo;
+	int shmevent; /* ShmCompletion event type */
+	int shmbusy; /* the server may still render into buf */
+	unsigned long shmserial; /* of the put ending the last frame */
+#endif
 } XWindow;
 
+/* Selection text, shared by the selections and the transfers serving it */
+typedef struct {
+	char *text;
+	size_t len;
+	int ref;
+} SelText;
+
+/* INCR transfer of a selection to a requestor, see selincr() */
+#define SELXFERTIMEOUT	5000 /* ms a requestor may take for a chunk */
+
+typedef struct SelTransfer SelTransfer;
+struct SelTransfer {
+	Window requestor;
+	Atom property, target;
+	SelText *sel;
+	size_t off;
+	int ready; /* the requestor took the last chunk */
+	struct timespec last;
+	SelTransfer *next;
+};
+
 typedef struct {
 	Atom xtarget;
-	char *primary, *clipboard;
+	SelText *primary, *clipboard;
+	SelTransfer *xfers;
+	size_t chunk; /* largest property written at once */
 	struct timespec tclick1;
 	struct timespec tclick2;
 } XSelection;
@@ -147,6 +192,9 @@ static int xmakeglyphfontspecs(XftGlyphFontSpec *, const Glyph *, int, int, int)
 static void xdrawglyphfontspecs(const XftGlyphFontSpec *, Glyph, int, int, int);
 static void xdrawglyph(Glyph, int, int);
 static void xclear(int, int, int, int);
+static void xdamage(int, int);
+static void xcreatebuf(void);
+static void xfreebuf(void);
 static int xgeommasktogravity(int);
 static int ximopen(Display *);
 static void ximinstantiate(Display *, XPointer, XPointer);
@@ -157,6 +205,7 @@ static void cresize(int, int);
 static void xresize(int, int);
 static void xhints(void);
 static int xloadcolor(int, const char *, Color *);
+static int xcachecolor(const XRenderColor *, Color *);
 static int xloadfont(Font *, FcPattern *);
 static void xloadfonts(const char *, double);
 static void xunloadfont(Font *);
@@ -170,6 +219,9 @@ static void expose(XEvent *);
 static void visibility(XEvent *);
 static void unmap(XEvent *);
 static void kpress(XEvent *);
+static void latkey(const struct timespec *);
+static void latdrawn(void);
+static double latpercentile(const uint *, double);
 static void cmessage(XEvent *);
 static void resize(XEvent *);
 static void focus(XEvent *);
@@ -177,12 +229,20 @@ static uint buttonmask(uint);
 static int mouseaction(XEvent *, uint);
 static void brelease(XEvent *);
 static void bpress(XEvent *);
+static void openlink(const char *);
 static void bmotion(XEvent *);
 static void propnotify(XEvent *);
 static void selnotify(XEvent *);
 static void selclear_(XEvent *);
 static void selrequest(XEvent *);
+static void selincr(XSelectionRequestEvent *, SelText *);
+static void selserve(void);
+static double seldeadline(void);
+static void seltrap(unsigned long);
 static void setsel(char *, Time);
+static SelText *seltextnew(char *);
+static void seltextfree(SelText *);
+static int xerror(Display *, XErrorEvent *);
 static void mousesel(XEvent *, int);
 static void mousereport(XEvent *);
 static char *kmap(KeySym, uint);
@@ -211,16 +271,20 @@ static void (*handler[LASTEvent])(XEvent *) = {
 	[SelectionNotify] = selnotify,
 /*
  * PropertyNotify is only turned on when there is some INCR transfer happening
- * for the selection retrieval.
+ * for the selection retrieval or for serving a large selection.
  */
 	[PropertyNotify] = propnotify,
 	[SelectionRequest] = selrequest,
 };
 
 /* Globals */
+static int (*xerrorxlib)(Display *, XErrorEvent *);
 static DC dc;
 static XWindow xw;
 static XSelection xsel;
+/* serials of the requests made on selection requestors, see xerror() */
+static struct { unsigned long first, last; } seltraps[16];
+static int seltrapi;
 static TermWindow win;
 
 /* Font Ring Cache */
@@ -237,6 +301,45 @@ typedef struct {
 	Rune unicodep;
 } Fontcache;
 
+/*
+ * Color cache for truecolor and derived (reverse, faint) colors. It is a
+ * small open addressing table keyed by the 16 bit RGBA value; when all
+ * probed slots are taken the home slot is evicted.
+ */
+#define COLCACHEBITS	9
+#define COLCACHEPROBE	8
+
+typedef struct {
+	uint64_t key;
+	int used;
+	Color col;
+} Colorcache;
+
+static Colorcache ccache[1 << COLCACHEBITS];
+
+/*
+ * Keypress to photon latency, measured with -L: from a keypress written to
+ * the tty, to the first output read back and to the XFlush() of the frame
+ * drawing it. Samples go to histograms of 0.1 ms buckets, the last bucket
+ * collects all slower ones.
+ */
+#define LATBUCKETS	1000
+#define LATRES		0.1
+
+enum { LAT_IDLE, LAT_KEY, LAT_ECHO };
+
+typedef struct {
+	int on;
+	int state;
+	struct timespec key, echo;
+	uint echohist[LATBUCKETS];
+	uint drawhist[LATBUCKETS];
+	uint n;
+	double max;
+} Latency;
+
+static Latency lat;
+
 /* Fontcache is an array now. A new font will be appended to the array. */
 static Fontcache *frc = NULL;
 static int frclen = 0;
@@ -252,6 +355,7 @@ static char *opt_font  = NULL;
 static char *opt_io    = NULL;
 static char *opt_line  = NULL;
 static char *opt_name  = NULL;
+static char *opt_rec   = NULL;
 static char *opt_title = NULL;
 
 static uint buttons; /* bit field of pressed buttons */
@@ -261,11 +365,12 @@ clipcopy(const Arg *dummy)
 {
 	Atom clipboard;
 
-	free(xsel.clipboard);
+	seltextfree(xsel.clipboard);
 	xsel.clipboard = NULL;
 
 	if (xsel.primary != NULL) {
-		xsel.clipboard = xstrdup(xsel.primary);
+		xsel.clipboard = xsel.primary;
+		xsel.clipboard->ref++;
 		clipboard = XInternAtom(xw.dpy, "CLIPBOARD", 0);
 		XSetSelectionOwner(xw.dpy, clipboard, xw.win, CurrentTime);
 	}
@@ -473,6 +578,7 @@ bpress(XEvent *e)
 {
 	int btn = e->xbutton.button;
 	struct timespec now;
+	const char *link;
 	int snap;
 
 	if (1 <= btn && btn <= 11)
@@ -486,6 +592,12 @@ bpress(XEvent *e)
 	if (mouseaction(e, 0))
 		return;
 
+	if (btn == Button1 && match(linkmask, e->xbutton.state) &&
+	    (link = tlinkat(evcol(e), evrow(e)))) {
+		openlink(link);
+		return;
+	}
+
 	if (btn == Button1) {
 		/*
 		 * If the user clicks below predefined timeouts specific
@@ -506,13 +618,47 @@ bpress(XEvent *e)
 	}
 }
 
+void
+openlink(const char *link)
+{
+	char *args[] = { linkopener, (char *)link, NULL };
+	pid_t child;
+
+	/* fork twice, so the opener is not left as a zombie */
+	switch (child = fork()) {
+	case -1:
+		fprintf(stderr, "fork failed: %s\n", strerror(errno));
+		return;
+	case 0:
+		setsid();
+		if (fork() == 0) {
+			execvp(args[0], args);
+			fprintf(stderr, "execvp %s failed: %s\n", args[0],
+			        strerror(errno));
+		}
+		_exit(0);
+	}
+	waitpid(child, NULL, 0);
+}
+
 void
 propnotify(XEvent *e)
 {
 	XPropertyEvent *xpev;
+	SelTransfer *t;
 	Atom clipboard = XInternAtom(xw.dpy, "CLIPBOARD", 0);
 
 	xpev = &e->xproperty;
+	if (xpev->state == PropertyDelete && xpev->window != xw.win) {
+		for (t = xsel.xfers; t; t = t->next) {
+			if (t->requestor == xpev->window &&
+			    t->property == xpev->atom) {
+				t->ready = 1;
+				break;
+			}
+		}
+		return;
+	}
 	if (xpev->state == PropertyNewValue &&
 			(xpev->atom == XA_PRIMARY ||
 			 xpev->atom == clipboard)) {
@@ -625,7 +771,8 @@ selrequest(XEvent *e)
 	XSelectionRequestEvent *xsre;
 	XSelectionEvent xev;
 	Atom xa_targets, string, clipboard;
-	char *seltext;
+	SelText *seltext;
+	unsigned long first = NextRequest(xw.dpy);
 
 	xsre = (XSelectionRequestEvent *) e;
 	xev.type = SelectionNotify;
@@ -663,11 +810,14 @@ selrequest(XEvent *e)
 				xsre->selection);
 			return;
 		}
-		if (seltext != NULL) {
+		if (seltext != NULL && seltext->len > xsel.chunk) {
+			selincr(xsre, seltext);
+			xev.property = xsre->property;
+		} else if (seltext != NULL) {
 			XChangeProperty(xsre->display, xsre->requestor,
 					xsre->property, xsre->target,
 					8, PropModeReplace,
-					(uchar *)seltext, strlen(seltext));
+					(uchar *)seltext->text, seltext->len);
 			xev.property = xsre->property;
 		}
 	}
@@ -675,6 +825,141 @@ selrequest(XEvent *e)
 	/* all done, send a notification to the listener */
 	if (!XSendEvent(xsre->display, xsre->requestor, 1, 0, (XEvent *) &xev))
 		fprintf(stderr, "Error sending SelectionNotify event\n");
+	seltrap(first);
+}
+
+/*
+ * Large selections are sent in chunks with the INCR protocol: the requestor
+ * deletes the property to ask for the next chunk, and the chunks are then
+ * written by selserve() from run(), between reads of the tty.
+ */
+void
+selincr(XSelectionRequestEvent *xsre, SelText *sel)
+{
+	SelTransfer *t;
+	Atom incr = XInternAtom(xw.dpy, "INCR", 0);
+	long len = sel->len;
+
+	t = xmalloc(sizeof(*t));
+	*t = (SelTransfer){
+		.requestor = xsre->requestor,
+		.property = xsre->property,
+		.target = xsre->target,
+		.sel = sel,
+		.next = xsel.xfers,
+	};
+	clock_gettime(CLOCK_MONOTONIC, &t->last);
+	sel->ref++;
+	xsel.xfers = t;
+
+	XSelectInput(xw.dpy, t->requestor, PropertyChangeMask);
+	XChangeProperty(xw.dpy, t->requestor, t->property, incr, 32,
+			PropModeReplace, (uchar *)&len, 1);
+}
+
+/* ms until selserve() gives up on the next stalled transfer, or -1 */
+double
+seldeadline(void)
+{
+	SelTransfer *t;
+	struct timespec now;
+	double left, min = -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (t = xsel.xfers; t; t = t->next) {
+		if (t->ready)
+			continue;
+		left = MAX(SELXFERTIMEOUT + 1 - TIMEDIFF(now, t->last), 0);
+		if (min < 0 || left < min)
+			min = left;
+	}
+	return min;
+}
+
+void
+selserve(void)
+{
+	SelTransfer **tp, *t, *o;
+	struct timespec now;
+	size_t n;
+	int sent = 0;
+	unsigned long first = NextRequest(xw.dpy);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (tp = &xsel.xfers; (t = *tp); ) {
+		if (!t->ready) {
+			/* the requestor went away */
+			if (TIMEDIFF(now, t->last) > SELXFERTIMEOUT)
+				goto done;
+			tp = &t->next;
+			continue;
+		}
+		n = MIN(t->sel->len - t->off, xsel.chunk);
+		XChangeProperty(xw.dpy, t->requestor, t->property, t->target,
+				8, PropModeReplace, (uchar *)&t->sel->text[t->off], n);
+		t->off += n;
+		t->ready = 0;
+		t->last = now;
+		sent = 1;
+		/* the empty chunk ends the transfer */
+		if (n > 0) {
+			tp = &t->next;
+			continue;
+		}
+done:
+		*tp = t->next;
+		/* other transfers to the same requestor still need the events */
+		for (o = xsel.xfers; o && o->requestor != t->requestor; o = o->next)
+			;
+		if (!o) {
+			XSelectInput(xw.dpy, t->requestor, NoEventMask);
+			sent = 1;
+		}
+		seltextfree(t->sel);
+		free(t);
+	}
+	if (sent) {
+		seltrap(first);
+		XFlush(xw.dpy);
+	}
+}
+
+/* record the requests since serial first as made on requestors */
+void
+seltrap(unsigned long first)
+{
+	unsigned long last = NextRequest(xw.dpy) - 1;
+
+	if (last < first)
+		return;
+	if (seltraps[seltrapi].last + 1 == first) {
+		seltraps[seltrapi].last = last;
+		return;
+	}
+	seltrapi = (seltrapi + 1) % LEN(seltraps);
+	seltraps[seltrapi].first = first;
+	seltraps[seltrapi].last = last;
+}
+
+SelText *
+seltextnew(char *str)
+{
+	SelText *sel = xmalloc(sizeof(*sel));
+
+	sel->text = str;
+	sel->len = strlen(str);
+	sel->ref = 1;
+
+	return sel;
+}
+
+void
+seltextfree(SelText *sel)
+{
+	if (!sel || --sel->ref > 0)
+		return;
+	free(sel->text);
+	free(sel);
 }
 
 void
@@ -683,8 +968,8 @@ setsel(char *str, Time t)
 	if (!str)
 		return;
 
-	free(xsel.primary);
-	xsel.primary = str;
+	seltextfree(xsel.primary);
+	xsel.primary = seltextnew(str);
 
 	XSetSelectionOwner(xw.dpy, XA_PRIMARY, xw.win, t);
 	if (XGetSelectionOwner(xw.dpy, XA_PRIMARY) != xw.win)
@@ -756,14 +1041,16 @@ xresize(int col, int row)
 	win.tw = col * win.cw;
 	win.th = row * win.ch;
 
-	XFreePixmap(xw.dpy, xw.buf);
-	xw.buf = XCreatePixmap(xw.dpy, xw.win, win.w, win.h,
-			DefaultDepth(xw.dpy, xw.scr));
+	xfreebuf();
+	xcreatebuf();
 	XftDrawChange(xw.draw, xw.buf);
 	xclear(0, 0, win.w, win.h);
 
 	/* resize to new width */
 	xw.specbuf = xrealloc(xw.specbuf, col * sizeof(GlyphFontSpec));
+#ifdef HARFBUZZ
+	xw.specrunes = xrealloc(xw.specrunes, col * sizeof(Rune));
+#endif
 }
 
 ushort
@@ -821,6 +1108,39 @@ xloadcols(void)
 	loaded = 1;
 }
 
+int
+xcachecolor(const XRenderColor *rc, Color *ncolor)
+{
+	uint64_t key = (uint64_t)rc->red << 48 | (uint64_t)rc->green << 32
+	             | (uint64_t)rc->blue << 16 | rc->alpha;
+	uint h = (key * 0x9E3779B97F4A7C15ULL) >> (64 - COLCACHEBITS);
+	Colorcache *cc;
+	int i;
+
+	for (i = 0; i < COLCACHEPROBE; i++) {
+		cc = &ccache[(h + i) & (LEN(ccache) - 1)];
+		if (!cc->used)
+			break;
+		if (cc->key == key) {
+			*ncolor = cc->col;
+			return 1;
+		}
+	}
+	if (i == COLCACHEPROBE) {
+		cc = &ccache[h];
+		XftColorFree(xw.dpy, xw.vis, xw.cmap, &cc->col);
+		cc->used = 0;
+	}
+
+	if (!XftColorAllocValue(xw.dpy, xw.vis, xw.cmap, rc, &cc->col))
+		return 0;
+	cc->key = key;
+	cc->used = 1;
+	*ncolor = cc->col;
+
+	return 1;
+}
+
 int
 xgetcolor(int x, unsigned char *r, unsigned char *g, unsigned char *b)
 {
@@ -851,12 +1171,133 @@ xsetcolorname(int x, const char *name)
 	return 0;
 }
 
+#ifdef XSHM
+static int shmerror;
+
+/* a server that cannot map the segment answers the attach with an error */
+static int
+xshmerror(Display *dpy, XErrorEvent *ee)
+{
+	shmerror = 1;
+	return 0;
+}
+
+int
+xshminit(void)
+{
+	int major, minor;
+	Bool pixmaps;
+	const char *dname = DisplayString(xw.dpy);
+
+	/* shared memory only works with a server on the same host */
+	if (dname[0] != ':' && strncmp(dname, "unix:", 5))
+		return 0;
+	if (!XShmQueryVersion(xw.dpy, &major, &minor, &pixmaps) || !pixmaps)
+		return 0;
+	xw.shmevent = XShmGetEventBase(xw.dpy) + ShmCompletion;
+
+	return XShmPixmapFormat(xw.dpy) == ZPixmap;
+}
+
+int
+xshmcreatebuf(void)
+{
+	XShmSegmentInfo *si = &xw.shminfo;
+	int depth = DefaultDepth(xw.dpy, xw.scr);
+	int (*handler)(Display *, XErrorEvent *);
+
+	xw.shmimg = XShmCreateImage(xw.dpy, xw.vis, depth, ZPixmap, NULL, si,
+			win.w, win.h);
+	if (!xw.shmimg)
+		return 0;
+
+	si->shmid = shmget(IPC_PRIVATE,
+			xw.shmimg->bytes_per_line * xw.shmimg->height,
+			IPC_CREAT | 0600);
+	if (si->shmid < 0)
+		goto err_img;
+	si->shmaddr = xw.shmimg->data = shmat(si->shmid, NULL, 0);
+	si->readOnly = False;
+	if (si->shmaddr == (char *)-1)
+		goto err_id;
+	XSync(xw.dpy, False);
+	shmerror = 0;
+	handler = XSetErrorHandler(xshmerror);
+	if (!XShmAttach(xw.dpy, si))
+		shmerror = 1;
+	XSync(xw.dpy, False);
+	XSetErrorHandler(handler);
+	if (shmerror)
+		goto err_at;
+	/* the segment goes away as soon as both sides detach */
+	shmctl(si->shmid, IPC_RMID, NULL);
+
+	xw.buf = XShmCreatePixmap(xw.dpy, xw.win, si->shmaddr, si,
+			win.w, win.h, depth);
+	return 1;
+
+err_at:
+	shmdt(si->shmaddr);
+err_id:
+	shmctl(si->shmid, IPC_RMID, NULL);
+err_img:
+	xw.shmimg->data = NULL;
+	XDestroyImage(xw.shmimg);
+	xw.shmimg = NULL;
+	return 0;
+}
+#endif
+
+void
+xcreatebuf(void)
+{
+#ifdef XSHM
+	if (xw.useshm) {
+		if (xshmcreatebuf())
+			return;
+		fprintf(stderr, "MIT-SHM: falling back to a server pixmap\n");
+		xw.useshm = 0;
+	}
+#endif
+	xw.buf = XCreatePixmap(xw.dpy, xw.win, win.w, win.h,
+			DefaultDepth(xw.dpy, xw.scr));
+}
+
+void
+xfreebuf(void)
+{
+	XFreePixmap(xw.dpy, xw.buf);
+#ifdef XSHM
+	if (xw.useshm) {
+		XShmDetach(xw.dpy, &xw.shminfo);
+		XSync(xw.dpy, False);
+		xw.shmbusy = 0;
+		shmdt(xw.shminfo.shmaddr);
+		xw.shmimg->data = NULL;
+		XDestroyImage(xw.shmimg);
+		xw.shmimg = NULL;
+	}
+#endif
+}
+
+/*
+ * Record that the pixel rows [y1, y2) of buf changed and have to be copied
+ * to the window by the next xfinishdraw.
+ */
+void
+xdamage(int y1, int y2)
+{
+	xw.dy1 = MIN(xw.dy1, MAX(y1, 0));
+	xw.dy2 = MAX(xw.dy2, MIN(y2, win.h));
+}
+
 /*
  * Absolute coordinates.
  */
 void
 xclear(int x1, int y1, int x2, int y2)
 {
+	xdamage(y1, y2);
 	XftDrawRect(xw.draw,
 			&dc.col[IS_SET(MODE_REVERSE)? defaultfg : defaultbg],
 			x1, y1, x2-x1, y2-y1);
@@ -1068,6 +1509,10 @@ xunloadfont(Font *f)
 void
 xunloadfonts(void)
 {
+#ifdef HARFBUZZ
+	/* the HarfBuzz fonts hold the faces of the Xft fonts locked */
+	hbunloadfonts();
+#endif
 	/* Free the loaded fonts in the font cache.  */
 	while (frclen > 0)
 		XftFontClose(xw.dpy, frc[--frclen].font);
@@ -1143,6 +1588,7 @@ xinit(int cols, int rows)
 
 	if (!(xw.dpy = XOpenDisplay(NULL)))
 		die("can't open display\n");
+	xerrorxlib = XSetErrorHandler(xerror);
 	xw.scr = XDefaultScreen(xw.dpy);
 	xw.vis = XDefaultVisual(xw.dpy, xw.scr);
 
@@ -1185,13 +1631,19 @@ xinit(int cols, int rows)
 	gcvalues.graphics_exposures = False;
 	dc.gc = XCreateGC(xw.dpy, parent, GCGraphicsExposures,
 			&gcvalues);
-	xw.buf = XCreatePixmap(xw.dpy, xw.win, win.w, win.h,
-			DefaultDepth(xw.dpy, xw.scr));
+#ifdef XSHM
+	xw.useshm = useshm && xshminit();
+#endif
+	xcreatebuf();
 	XSetForeground(xw.dpy, dc.gc, dc.col[defaultbg].pixel);
 	XFillRectangle(xw.dpy, xw.buf, dc.gc, 0, 0, win.w, win.h);
+	xdamage(0, win.h);
 
 	/* font spec buffer */
 	xw.specbuf = xmalloc(cols * sizeof(GlyphFontSpec));
+#ifdef HARFBUZZ
+	xw.specrunes = xmalloc(cols * sizeof(Rune));
+#endif
 
 	/* Xft rendering context */
 	xw.draw = XftDrawCreate(xw.dpy, xw.buf, xw.vis, xw.cmap);
@@ -1240,6 +1692,9 @@ xinit(int cols, int rows)
 	clock_gettime(CLOCK_MONOTONIC, &xsel.tclick2);
 	xsel.primary = NULL;
 	xsel.clipboard = NULL;
+	xsel.xfers = NULL;
+	/* leave room for the request header */
+	xsel.chunk = MIN(XMaxRequestSize(xw.dpy) * 4 - 256, 1 << 18);
 	xsel.xtarget = XInternAtom(xw.dpy, "UTF8_STRING", 0);
 	if (xsel.xtarget == None)
 		xsel.xtarget = XA_STRING;
@@ -1296,6 +1751,9 @@ xmakeglyphfontspecs(XftGlyphFontSpec *specs, const Glyph *glyphs, int len, int x
 			specs[numspecs].glyph = glyphidx;
 			specs[numspecs].x = (short)xp;
 			specs[numspecs].y = (short)yp;
+#ifdef HARFBUZZ
+			xw.specrunes[numspecs] = rune;
+#endif
 			xp += runewidth;
 			numspecs++;
 			continue;
@@ -1370,10 +1828,17 @@ xmakeglyphfontspecs(XftGlyphFontSpec *specs, const Glyph *glyphs, int len, int x
 		specs[numspecs].glyph = glyphidx;
 		specs[numspecs].x = (short)xp;
 		specs[numspecs].y = (short)yp;
+#ifdef HARFBUZZ
+		xw.specrunes[numspecs] = rune;
+#endif
 		xp += runewidth;
 		numspecs++;
 	}
 
+#ifdef HARFBUZZ
+	hbtransform(specs, xw.specrunes, numspecs);
+#endif
+
 	return numspecs;
 }
 
@@ -1401,7 +1866,7 @@ xdrawglyphfontspecs(const XftGlyphFontSpec *specs, Glyph base, int len, int x, i
 		colfg.red = TRUERED(base.fg);
 		colfg.green = TRUEGREEN(base.fg);
 		colfg.blue = TRUEBLUE(base.fg);
-		XftColorAllocValue(xw.dpy, xw.vis, xw.cmap, &colfg, &truefg);
+		xcachecolor(&colfg, &truefg);
 		fg = &truefg;
 	} else {
 		fg = &dc.col[base.fg];
@@ -1412,7 +1877,7 @@ xdrawglyphfontspecs(const XftGlyphFontSpec *specs, Glyph base, int len, int x, i
 		colbg.green = TRUEGREEN(base.bg);
 		colbg.red = TRUERED(base.bg);
 		colbg.blue = TRUEBLUE(base.bg);
-		XftColorAllocValue(xw.dpy, xw.vis, xw.cmap, &colbg, &truebg);
+		xcachecolor(&colbg, &truebg);
 		bg = &truebg;
 	} else {
 		bg = &dc.col[base.bg];
@@ -1430,8 +1895,7 @@ xdrawglyphfontspecs(const XftGlyphFontSpec *specs, Glyph base, int len, int x, i
 			colfg.green = ~fg->color.green;
 			colfg.blue = ~fg->color.blue;
 			colfg.alpha = fg->color.alpha;
-			XftColorAllocValue(xw.dpy, xw.vis, xw.cmap, &colfg,
-					&revfg);
+			xcachecolor(&colfg, &revfg);
 			fg = &revfg;
 		}
 
@@ -1442,8 +1906,7 @@ xdrawglyphfontspecs(const XftGlyphFontSpec *specs, Glyph base, int len, int x, i
 			colbg.green = ~bg->color.green;
 			colbg.blue = ~bg->color.blue;
 			colbg.alpha = bg->color.alpha;
-			XftColorAllocValue(xw.dpy, xw.vis, xw.cmap, &colbg,
-					&revbg);
+			xcachecolor(&colbg, &revbg);
 			bg = &revbg;
 		}
 	}
@@ -1453,7 +1916,7 @@ xdrawglyphfontspecs(const XftGlyphFontSpec *specs, Glyph base, int len, int x, i
 		colfg.green = fg->color.green / 2;
 		colfg.blue = fg->color.blue / 2;
 		colfg.alpha = fg->color.alpha;
-		XftColorAllocValue(xw.dpy, xw.vis, xw.cmap, &colfg, &revfg);
+		xcachecolor(&colfg, &revfg);
 		fg = &revfg;
 	}
 
@@ -1485,6 +1948,7 @@ xdrawglyphfontspecs(const XftGlyphFontSpec *specs, Glyph base, int len, int x, i
 		xclear(winx, winy + win.ch, winx + width, win.h);
 
 	/* Clean up the region we want to draw to. */
+	xdamage(winy, winy + win.ch);
 	XftDrawRect(xw.draw, bg, winx, winy, width, win.ch);
 
 	/* Set the clip region because Xft is sometimes dirty. */
@@ -1562,6 +2026,7 @@ xdrawcursor(int cx, int cy, Glyph g, int ox, int oy, Glyph og)
 	}
 
 	/* draw the new one */
+	xdamage(win.vborderpx + cy * win.ch, win.vborderpx + (cy + 1) * win.ch);
 	if (IS_SET(MODE_FOCUSED)) {
 		switch (win.cursor) {
 		case 7: /* st extension */
@@ -1682,11 +2147,59 @@ xdrawline(Line line, int x1, int y1, int x2)
 		xdrawglyphfontspecs(specs, base, i, ox, y1);
 }
 
+/*
+ * Move the text area of buf up by n rows (down if n < 0). The rows which
+ * are uncovered keep stale pixels; the terminal marks them dirty.
+ */
+void
+xscroll(int n)
+{
+	int h = win.th - abs(n) * win.ch;
+	int src = win.vborderpx + MAX(n, 0) * win.ch;
+	int dst = win.vborderpx + MAX(-n, 0) * win.ch;
+
+	if (h <= 0)
+		return;
+
+#ifdef XSHM
+	if (xw.useshm) {
+		/* wait until the server is done rendering into buf */
+		if (xw.shmbusy) {
+			XSync(xw.dpy, False);
+			xw.shmbusy = 0;
+		}
+		memmove(xw.shmimg->data + dst * xw.shmimg->bytes_per_line,
+				xw.shmimg->data + src * xw.shmimg->bytes_per_line,
+				h * xw.shmimg->bytes_per_line);
+	} else
+#endif
+	XCopyArea(xw.dpy, xw.buf, xw.buf, dc.gc, 0, src, win.w, h, 0, dst);
+
+	xdamage(win.vborderpx, win.vborderpx + win.th);
+}
+
 void
 xfinishdraw(void)
 {
-	XCopyArea(xw.dpy, xw.buf, xw.win, dc.gc, 0, 0, win.w,
-			win.h, 0, 0);
+	/* only copy the rows which changed since the last frame */
+	if (xw.dy1 < xw.dy2) {
+		XCopyArea(xw.dpy, xw.buf, xw.win, dc.gc, 0, xw.dy1, win.w,
+				xw.dy2 - xw.dy1, 0, xw.dy1);
+	}
+	xw.dy1 = win.h;
+	xw.dy2 = 0;
+#ifdef XSHM
+	/*
+	 * A put of one pixel of buf onto itself is a no-op whose completion
+	 * event tells that the rendering of the frame is done, see xscroll.
+	 */
+	if (xw.useshm) {
+		xw.shmserial = NextRequest(xw.dpy);
+		XShmPutImage(xw.dpy, xw.buf, dc.gc, xw.shmimg, 0, 0, 0, 0, 1, 1,
+				True);
+		xw.shmbusy = 1;
+	}
+#endif
 	XSetForeground(xw.dpy, dc.gc,
 			dc.col[IS_SET(MODE_REVERSE)?
 				defaultfg : defaultbg].pixel);
@@ -1759,6 +2272,25 @@ xseturgency(int add)
 	XFree(h);
 }
 
+/*
+ * The requestor of a selection may be destroyed at any time, errors about
+ * vanished windows are harmless for the requests made on it.
+ */
+int
+xerror(Display *dpy, XErrorEvent *ee)
+{
+	int i;
+
+	if (ee->error_code == BadWindow) {
+		for (i = 0; i < LEN(seltraps); i++) {
+			if (BETWEEN(ee->serial, seltraps[i].first,
+			            seltraps[i].last))
+				return 0;
+		}
+	}
+	return xerrorxlib(dpy, ee);
+}
+
 void
 xbell(void)
 {
@@ -1845,9 +2377,12 @@ kpress(XEvent *ev)
 	Rune c;
 	Status status;
 	Shortcut *bp;
+	struct timespec now;
 
 	if (IS_SET(MODE_KBDLOCK))
 		return;
+	if (lat.on)
+		clock_gettime(CLOCK_MONOTONIC, &now);
 
 	if (xw.ime.xic) {
 		len = XmbLookupString(xw.ime.xic, e, buf, sizeof buf, &ksym, &status);
@@ -1866,6 +2401,8 @@ kpress(XEvent *ev)
 
 	/* 2. custom keys from config.h */
 	if ((customkey = kmap(ksym, e->state))) {
+		if (lat.on)
+			latkey(&now);
 		ttywrite(customkey, strlen(customkey), 1);
 		return;
 	}
@@ -1885,9 +2422,74 @@ kpress(XEvent *ev)
 			len = 2;
 		}
 	}
+	if (lat.on)
+		latkey(&now);
 	ttywrite(buf, len, 1);
 }
 
+void
+latkey(const struct timespec *now)
+{
+	if (lat.state != LAT_IDLE)
+		return;
+	lat.key = *now;
+	lat.state = LAT_KEY;
+}
+
+void
+latdrawn(void)
+{
+	struct timespec now;
+	double echo, drawn;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	echo = TIMEDIFF(lat.echo, lat.key);
+	drawn = TIMEDIFF(now, lat.key);
+	lat.echohist[MIN((int)(echo / LATRES), LATBUCKETS - 1)]++;
+	lat.drawhist[MIN((int)(drawn / LATRES), LATBUCKETS - 1)]++;
+	lat.max = MAX(lat.max, drawn);
+	lat.n++;
+	lat.state = LAT_IDLE;
+}
+
+double
+latpercentile(const uint *hist, double p)
+{
+	uint sum = 0;
+	int i;
+
+	for (i = 0; i < LATBUCKETS - 1; i++) {
+		if ((sum += hist[i]) >= p * lat.n)
+			break;
+	}
+	return (i + 1) * LATRES;
+}
+
+void
+latreport(const Arg *arg)
+{
+	if (!lat.on || !lat.n)
+		return;
+	fprintf(stderr, "latency of %u keys in ms (minlatency %g, maxlatency %g"
+	        ", %s): echo p50 %.1f p99 %.1f, drawn p50 %.1f p99 %.1f max %.1f\n",
+	        lat.n, minlatency, maxlatency,
+#ifdef XSHM
+	        xw.useshm ? "shm" : "pixmap",
+#else
+	        "pixmap",
+#endif
+	        latpercentile(lat.echohist, 0.5), latpercentile(lat.echohist, 0.99),
+	        latpercentile(lat.drawhist, 0.5), latpercentile(lat.drawhist, 0.99),
+	        lat.max);
+}
+
+/* called on every way out, -L prints its report here */
+void
+xexit(void)
+{
+	latreport(NULL);
+}
+
 void
 cmessage(XEvent *e)
 {
@@ -1923,9 +2525,10 @@ run(void)
 	XEvent ev;
 	int w = win.w, h = win.h;
 	fd_set rfd;
-	int xfd = XConnectionNumber(xw.dpy), ttyfd, xev, drawing;
-	struct timespec seltv, *tv, now, lastblink, trigger;
-	double timeout;
+	int xfd = XConnectionNumber(xw.dpy), ttyfd, xev, drawing, compacted;
+	int throttled;
+	struct timespec seltv, *tv, now, lastblink, trigger, lastout, rdone;
+	double timeout, wait, reap, idle, busy;
 
 	/* Waiting for window mapping */
 	do {
@@ -1945,18 +2548,29 @@ run(void)
 
 	ttyfd = ttynew(opt_line, shell, opt_io, opt_cmd);
 	cresize(w, h);
+	clock_gettime(CLOCK_MONOTONIC, &lastout);
+	trigger = lastout;
 
-	for (timeout = -1, drawing = 0, lastblink = (struct timespec){0};;) {
+	for (timeout = -1, drawing = 0, compacted = 0, busy = 0, throttled = 0,
+	     lastblink = (struct timespec){0};;) {
 		FD_ZERO(&rfd);
-		FD_SET(ttyfd, &rfd);
+		/* out of parse budget: leave the output in the kernel */
+		if (!throttled)
+			FD_SET(ttyfd, &rfd);
 		FD_SET(xfd, &rfd);
 
 		if (XPending(xw.dpy))
 			timeout = 0;  /* existing events might not set xfd */
 
-		seltv.tv_sec = timeout / 1E3;
-		seltv.tv_nsec = 1E6 * (timeout - 1E3 * seltv.tv_sec);
-		tv = timeout >= 0 ? &seltv : NULL;
+		/* wake up to reap transfers nobody asks for anymore */
+		wait = timeout;
+		if (xsel.xfers && (reap = seldeadline()) >= 0 &&
+		    (wait < 0 || reap < wait))
+			wait = reap;
+
+		seltv.tv_sec = wait / 1E3;
+		seltv.tv_nsec = 1E6 * (wait - 1E3 * seltv.tv_sec);
+		tv = wait >= 0 ? &seltv : NULL;
 
 		if (pselect(MAX(xfd, ttyfd)+1, &rfd, NULL, NULL, tv, NULL) < 0) {
 			if (errno == EINTR)
@@ -1965,8 +2579,20 @@ run(void)
 		}
 		clock_gettime(CLOCK_MONOTONIC, &now);
 
-		if (FD_ISSET(ttyfd, &rfd))
+		if (FD_ISSET(ttyfd, &rfd)) {
+			if (lat.state == LAT_KEY) {
+				lat.echo = now;
+				lat.state = LAT_ECHO;
+			}
 			ttyread();
+			lastout = now;
+			compacted = 0;
+			if (ttybudget) {
+				clock_gettime(CLOCK_MONOTONIC, &rdone);
+				busy += TIMEDIFF(rdone, now);
+				throttled = busy >= ttybudget;
+			}
+		}
 
 		xev = 0;
 		while (XPending(xw.dpy)) {
@@ -1974,9 +2600,18 @@ run(void)
 			XNextEvent(xw.dpy, &ev);
 			if (XFilterEvent(&ev, None))
 				continue;
+#ifdef XSHM
+			if (xw.useshm && ev.type == xw.shmevent) {
+				if (ev.xany.serial >= xw.shmserial)
+					xw.shmbusy = 0;
+				continue;
+			}
+#endif
 			if (handler[ev.type])
 				(handler[ev.type])(&ev);
 		}
+		if (xsel.xfers)
+			selserve();
 
 		/*
 		 * To reduce flicker and tearing, when new content or event
@@ -2000,6 +2635,31 @@ run(void)
 				continue;  /* we have time, try to find idle */
 		}
 
+		/*
+		 * The output arrives faster than it can be parsed within the
+		 * budget. Don't look for idle, just draw one frame every
+		 * maxlatency ms and resume reading after it; everything in
+		 * between is never shown.
+		 */
+		if (throttled) {
+			timeout = maxlatency - TIMEDIFF(now, trigger);
+			if (timeout > 0)
+				continue;
+			busy = 0;
+			throttled = 0;
+		}
+
+		if (tinsync(su_timeout)) {
+			/*
+			 * on synchronized-update draw-suspension: don't reset
+			 * drawing so that we draw ASAP once we can (just after
+			 * the update ends). set timeout > 0 to draw on the
+			 * su_timeout even without new content.
+			 */
+			timeout = minlatency;
+			continue;
+		}
+
 		/* idle detected or maxlatency exhausted -> draw */
 		timeout = -1;
 		if (blinktimeout && tattrset(ATTR_BLINK)) {
@@ -2017,18 +2677,35 @@ run(void)
 		draw();
 		XFlush(xw.dpy);
 		drawing = 0;
+		if (lat.state == LAT_ECHO && IS_SET(MODE_VISIBLE))
+			latdrawn();
+		/* keys which are never echoed */
+		if (lat.state == LAT_KEY && TIMEDIFF(now, lat.key) > 1000)
+			lat.state = LAT_IDLE;
+		busy = 0;
+
+		/* release memory once the terminal went quiet */
+		if (compacttimeout && !compacted) {
+			idle = compacttimeout * 1E3 - TIMEDIFF(now, lastout);
+			if (idle <= 0) {
+				tcompact();
+				compacted = 1;
+			} else if (timeout < 0 || idle < timeout) {
+				timeout = idle;
+			}
+		}
 	}
 }
 
 void
 usage(void)
 {
-	die("usage: %s [-aiv] [-c class] [-f font] [-g geometry]"
-	    " [-n name] [-o file]\n"
+	die("usage: %s [-aiLv] [-c class] [-f font] [-g geometry]"
+	    " [-n name] [-o file] [-r file]\n"
 	    "          [-T title] [-t title] [-w windowid]"
 	    " [[-e] command [args ...]]\n"
-	    "       %s [-aiv] [-c class] [-f font] [-g geometry]"
-	    " [-n name] [-o file]\n"
+	    "       %s [-aiLv] [-c class] [-f font] [-g geometry]"
+	    " [-n name] [-o file] [-r file]\n"
 	    "          [-T title] [-t title] [-w windowid] -l line"
 	    " [stty_args ...]\n", argv0, argv0);
 }
@@ -2067,9 +2744,16 @@ main(int argc, char *argv[])
 	case 'l':
 		opt_line = EARGF(usage());
 		break;
+	case 'L':
+		lat.on = 1;
+		atexit(xexit);
+		break;
 	case 'n':
 		opt_name = EARGF(usage());
 		break;
+	case 'r':
+		opt_rec = EARGF(usage());
+		break;
 	case 't':
 	case 'T':
 		opt_title = EARGF(usage());
@@ -2096,6 +2780,8 @@ run:
 	cols = MAX(cols, 1);
 	rows = MAX(rows, 1);
 	tnew(cols, rows);
+	if (opt_rec)
+		ttyrecord(opt_rec);
 	xinit(cols, rows);
 	xsetenv();
 	selinit();